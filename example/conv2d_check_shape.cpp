@@ -28,26 +28,32 @@ void conv2d_check_shape(long i_rank, long i0, long i1, long i2, long i3,
   TORCH_CHECK(kernel_size_correct);
 }
 
+struct {
+  pathfinder::EnumArg i_rank, w_rank;
+  pathfinder::IntArg i0, i1, i2, i3, i4, w0, w1, w2, w3, w4, p0, p1, d0, d1,
+      groups;
+} arg;
+
 extern "C" {
 
 void PathFinderSetup() {
-  PathFinderEnumArg("i_rank", 6);
-  PathFinderIntArg("i0");
-  PathFinderIntArg("i1");
-  PathFinderIntArg("i2");
-  PathFinderIntArg("i3");
-  PathFinderIntArg("i4");
-  PathFinderEnumArg("w_rank", 6);
-  PathFinderIntArg("w0");
-  PathFinderIntArg("w1");
-  PathFinderIntArg("w2");
-  PathFinderIntArg("w3");
-  PathFinderIntArg("w4");
-  PathFinderIntArg("p0");
-  PathFinderIntArg("p1");
-  PathFinderIntArg("d0");
-  PathFinderIntArg("d1");
-  PathFinderIntArg("groups");
+  arg.i_rank = PathFinderEnumArg("i_rank", 6);
+  arg.i0 = PathFinderIntArg("i0");
+  arg.i1 = PathFinderIntArg("i1");
+  arg.i2 = PathFinderIntArg("i2");
+  arg.i3 = PathFinderIntArg("i3");
+  arg.i4 = PathFinderIntArg("i4");
+  arg.w_rank = PathFinderEnumArg("w_rank", 6);
+  arg.w0 = PathFinderIntArg("w0");
+  arg.w1 = PathFinderIntArg("w1");
+  arg.w2 = PathFinderIntArg("w2");
+  arg.w3 = PathFinderIntArg("w3");
+  arg.w4 = PathFinderIntArg("w4");
+  arg.p0 = PathFinderIntArg("p0");
+  arg.p1 = PathFinderIntArg("p1");
+  arg.d0 = PathFinderIntArg("d0");
+  arg.d1 = PathFinderIntArg("d1");
+  arg.groups = PathFinderIntArg("groups");
   PathFinderAddHardConstraint({
       sym_int_arg["groups"] > 0,
   });
@@ -56,9 +62,9 @@ void PathFinderSetup() {
 int PathFinderTestOneInput(const pathfinder::Input& x) {
   try {
     PathFinderExecuteTarget(conv2d_check_shape(
-        x["i_rank"], x["i0"], x["i1"], x["i2"], x["i3"], x["i4"], x["w_rank"],
-        x["w0"], x["w1"], x["w2"], x["w3"], x["w4"], x["p0"], x["p1"], x["d0"],
-        x["d1"], x["groups"]));
+        x[arg.i_rank], x[arg.i0], x[arg.i1], x[arg.i2], x[arg.i3], x[arg.i4],
+        x[arg.w_rank], x[arg.w0], x[arg.w1], x[arg.w2], x[arg.w3], x[arg.w4],
+        x[arg.p0], x[arg.p1], x[arg.d0], x[arg.d1], x[arg.groups]));
   } catch (const ExpectedException& e) {
     return -2;
   }
@@ -10,7 +10,7 @@ function(example_fuzz_target target)
 
   add_executable(${target} ${fuzz_target_src} utils.cpp)
   target_compile_options(${target} PRIVATE -g -O0 -fsanitize=undefined)
-  target_compile_options(${target} PRIVATE -fsanitize-coverage=edge,trace-pc-guard)
+  target_compile_options(${target} PRIVATE -fsanitize-coverage=edge,trace-pc-guard,pc-table,trace-cmp)
   # To prevent missing basic blocks. See https://github.com/google/sanitizers/issues/783.
   target_compile_options(${target} PRIVATE -mllvm -sanitizer-coverage-prune-blocks=0)
 
@@ -29,6 +29,8 @@ class ConfusionMatrix {
   int64_t tn;
   int64_t fp;
   int64_t fn;
+
+  friend class Snapshot;
 };
 
 enum SynthesisStatus {
@@ -48,7 +50,7 @@ class BranchCondition {
   static const size_t MAX_SAMPLE_SIZE;
 
   BranchCondition(CondType condtype_);
-  BranchCondition(const BranchCondition& other) = default;
+  BranchCondition(const BranchCondition& other);
   virtual ~BranchCondition() = default;
   virtual bool operator==(const BranchCondition& other) const;
 
@@ -67,6 +69,7 @@ class BranchCondition {
   virtual std::string to_string() const = 0;
 
   CondType get_condtype() const;
+  uint64_t get_serial() const;
 
  protected:
   ConfusionMatrix cmat;
@@ -78,10 +81,14 @@ class BranchCondition {
       bool is_pair, const std::set<Input>& pos_examples,
       const std::set<Input>& neg_examples) = 0;
 
+  static uint64_t next_serial;
+
   CondType condtype;
   int64_t synthesis_budget;
+  uint64_t serial;  // unique to each condition, copies included
 
   friend class Node;
+  friend class Snapshot;
 };
 
 class EnumCondition : public BranchCondition {
@@ -111,11 +118,13 @@ class EnumCondition : public BranchCondition {
   std::unique_ptr<BoolExpr> equality_cond;
 
   friend class EnumSolver;
+  friend class Snapshot;
 };
 
 class NumericCondition : public BranchCondition {
  public:
   NumericCondition();
+  explicit NumericCondition(std::unique_ptr<BoolExpr> cond_);
   NumericCondition(const NumericCondition& other);
   virtual bool operator==(const NumericCondition& other) const;
 
@@ -135,6 +144,7 @@ class NumericCondition : public BranchCondition {
   std::unique_ptr<BoolExpr> cond;
 
   friend class NumericSolver;
+  friend class Snapshot;
 };
 
 class NeglectCondition : public BranchCondition {
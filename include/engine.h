@@ -2,7 +2,9 @@
 #define PATHFINDER_ENGINE
 
 #include "exectree.h"
+#include "fork_server.h"
 #include "input_generator.h"
+#include "scheduler.h"
 #include "sygus_gen.h"
 
 namespace pathfinder {
@@ -15,6 +17,7 @@ class Engine {
   void run_cmd_input();
   int run_corpus();
   void run_corpus_and_output_cov();
+  void resume(const std::string& filename);
   void synthesize_all();
   void warmingup(size_t cnt = 64);
   void run();
@@ -27,27 +30,32 @@ class Engine {
 
  private:
   void exit_if_time_up();
+  void save_snapshot();
   InputGenerator* ig();
   LeafNode* schedule();
   int run_one_input();
   std::unique_ptr<FunSynthesized> trivial_enum();
   std::unique_ptr<FunSynthesized> trivial_numeric();
   std::unique_ptr<SygusFile> make_sygus();
-  std::pair<int, ExecPath> run_callback(const Input& input,
-                                        bool measure_covered_pc_before_running,
-                                        bool is_initial_seed_);
+  std::pair<int, ExecPathView> run_callback(
+      const Input& input, bool measure_covered_pc_before_running,
+      bool is_initial_seed_);
   void check_run_result(int run_status);
   void set_generator(std::vector<EnumCondition*> enum_conditions,
                      std::vector<NumericCondition*> numeric_conditions);
+  std::vector<Flip> get_flips(Node* target);
   std::optional<Input> run_generator();
   void update_enum_bvs(Node* target);
   void refine(const std::set<Node*>& refinement_target);
 
   const std::string& potential_crash_prefix();
+  const std::string& timeout_prefix();
   fs::path output_file_path(const std::string& file_name);
   void write_to_output_corpus(Input arg);
   void commit_last_seed();
   void delete_last_seed();
+  void mark_last_seed_as_crash();
+  void mark_last_seed_as_timeout();
 
   UserCallback callback;
   size_t num_args;
@@ -60,7 +68,9 @@ class Engine {
   size_t solver_timeout;
 
   std::unique_ptr<ExecTree> exectree;
+  std::unique_ptr<Scheduler> scheduler;
   std::unique_ptr<InputGenerator> input_generator;
+  std::unique_ptr<ForkServer> fork_server;  // in fork server mode
 
   // timers(in ms)
   size_t time_warming_up = 0;
@@ -104,9 +114,12 @@ class Engine {
 
   size_t output_stat_interval = 300;
   size_t next_time_to_output_stat;
+  size_t next_time_to_snapshot;
 
   size_t num_pass = 0;
   size_t num_fail = 0;
+  size_t num_crash = 0;
+  size_t num_timeout = 0;
 
   // flag to check current phase.
   // used for printing properly.
@@ -62,6 +62,7 @@ class EnumArgBitVec {
   unsigned long bitvec = 0;
 
   friend class EnumArgBitVecArray;
+  friend class Snapshot;
 };
 
 class EnumArgBitVecArray {
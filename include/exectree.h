@@ -1,8 +1,11 @@
 #ifndef PATHFINDER_EXECTREE
 #define PATHFINDER_EXECTREE
 
+#include <unordered_map>
+
 #include "branch_condition.h"
 #include "pathfinder_defs.h"
+#include "spill_file.h"
 #include "sygus_ast.h"
 #include "trace_pc.h"
 #include "utils.h"
@@ -17,6 +20,13 @@ class ExecTree;
 class LeafNode;
 class InternalNode;
 
+// Prefix of a node, as a slice of `ExecTree::prefix_pool`. Slices are never
+// written in place, so splitting a prefix shares the pool.
+struct PrefixSlice {
+  uint32_t offset = 0;
+  uint32_t length = 0;
+};
+
 class Node {
  public:
   static const size_t MAX_INPUT_PER_PATH = 100;
@@ -26,36 +36,60 @@ class Node {
   Node(ExecTree* exectree_);
   virtual ~Node() = default;
   virtual bool struct_eq(const Node& other) const = 0;
-  virtual std::pair<Node*, ExecPath> find(ExecPath epath) = 0;
+  virtual std::pair<Node*, ExecPathView> find(ExecPathView epath) = 0;
   ExecPath get_path_log(bool squeeze = false);
   bool is_root() const;
   virtual bool is_internal() const = 0;
   virtual bool is_leaf() const = 0;
-  const ExecPath& get_prefix() const;
+  ExecPathView get_prefix() const;
+  uint32_t get_id() const;
   const EnumArgBitVecArray& get_enum_bvs() const;
+  size_t get_height() const;
+  size_t get_num_leaves() const;
+  size_t get_num_inputs() const;
   std::pair<std::vector<EnumCondition*>, std::vector<NumericCondition*>>
   get_path_cond();
   std::set<Node*> evaluate_condition(Input input);
+  void set_cond(std::unique_ptr<BranchCondition> cond_);
 
   void promote_cond();
   Node* lowest_common_ancestor(Node* other);
   virtual void filter_nd_pcid(TracePC* tpc, size_t prefix_len_so_far,
                               std::set<Node*>& filtered_nodes) = 0;
-  virtual void update_enum_bvs() = 0;
-  virtual void update_depth() = 0;
   size_t get_depth() const;
 
   virtual std::string to_string(bool print_prefix = false) const;
 
  protected:
+  void set_prefix(ExecPathView prefix);
+  void drop_prefix(size_t len);
+  const std::vector<Node*>& get_path_nodes();
+  void invalidate_path_cache();
+  virtual void refresh_aggregates() const = 0;
+
   ExecTree* exectree = nullptr;
   InternalNode* parent = nullptr;
-  ExecPath prefix;
-  EnumArgBitVecArray enum_bvs;
+  uint32_t id;            // unique in `exectree`, never reused
+  uint32_t registry_idx;  // in `exectree->internals` or `exectree->leaves`
+  PrefixSlice prefix;
   std::unique_ptr<BranchCondition> cond;
-  size_t depth = 0;
   bool exception_path = false;
 
+  // Aggregates of the subtree. Leaves keep theirs up to date, while internal
+  // nodes recompute theirs on access once invalidated.
+  mutable EnumArgBitVecArray enum_bvs;
+  mutable size_t height = 0;
+  mutable size_t num_leaves = 0;
+  mutable size_t num_inputs = 0;
+
+  // Nodes from the root to this node, and the conditions along them and of
+  // its epsilon child. A node's path is only cached while its parent's is.
+  std::vector<Node*> path_nodes;
+  bool path_nodes_valid = false;
+  std::vector<EnumCondition*> path_enum_conds;
+  std::vector<NumericCondition*> path_numeric_conds;
+  bool path_conds_valid = false;
+
  private:
   virtual std::set<Input> get_inputset() = 0;
   std::optional<Node*> get_sibling() const;
@@ -68,6 +102,7 @@ class Node {
   friend class InternalNode;
   friend class ExecTree;
   friend class Engine;
+  friend class Snapshot;
 };
 
 class LeafNode : public Node {
@@ -75,16 +110,21 @@ class LeafNode : public Node {
   LeafNode(ExecTree* exectree_);
   virtual bool struct_eq(const Node& other) const override;
 
-  void insert_inputset(ExecPath epath_tail, std::set<Input> inputset_,
-                       int run_status);
-  void merge_inputset(std::set<Input> inputset);
+  static const uint64_t NOT_SPILLED = UINT64_MAX;
+
+  void insert_inputset(ExecPathView epath_tail, std::set<Input> inputset_,
+                       int run_status, bool must_keep = false);
+  void merge_inputset(std::vector<Input> other, size_t other_num_seen);
   bool is_full() const;
+  bool is_spilled() const;
+  ExecPathView get_tail() const;
+  void record_run(size_t latency, size_t path_length);
+  double get_latency() const;
+  size_t get_num_runs() const;
 
-  virtual std::pair<Node*, ExecPath> find(ExecPath epath) override;
+  virtual std::pair<Node*, ExecPathView> find(ExecPathView epath) override;
   virtual bool is_internal() const override;
   virtual bool is_leaf() const override;
-  virtual void update_enum_bvs() override;
-  virtual void update_depth() override;
 
   virtual void filter_nd_pcid(TracePC* tpc, size_t prefix_len_so_far,
                               std::set<Node*>& filtered_nodes) override;
@@ -92,20 +132,48 @@ class LeafNode : public Node {
   virtual std::string to_string(bool print_prefix = false) const override;
 
  private:
+  virtual void refresh_aggregates() const override;
+  void update_aggregates();
+  bool has_input(const Input& input) const;
+  void put_input(const Input& input);
+  void add_input(const Input& input, bool must_keep);
   Input evict_random();
   virtual std::set<Input> get_inputset() override;
+  size_t estimate_bytes() const;
 
-  std::set<Input> inputset;
+  // A reservoir sample of the `num_seen` inputs inserted so far, sorted by id.
+  std::vector<Input> inputset;
+  size_t num_seen = 0;
   ExecPath tail;
+  uint64_t path_hash = 0;
+
+  // While spilled, `inputset` and `tail` are empty, and kept in the record of
+  // `spill_size` words at `spill_offset` of `exectree->spill_file`. The
+  // record is kept once paged in, and reused if spilled again unchanged.
+  bool spilled = false;
+  uint64_t spill_offset = NOT_SPILLED;
+  size_t spill_size = 0;
+  size_t resident_bytes = 0;  // as accounted in `exectree->resident_bytes`
+  size_t last_used = 0;
+
+  // Exponential moving averages over runs of generated inputs on its path,
+  // in ns and PCIDs.
+  double latency_ema = 0;
+  double path_length_ema = 0;
+  size_t num_runs = 0;
 
   // TODO: remove this workaround
   friend class Node;
   friend class ExecTree;
   friend class Engine;
+  friend class Snapshot;
 };
 
 class InternalNode : public Node {
  public:
+  // Children are indexed by their first PCID from this fan-out on.
+  static const size_t CHILD_INDEX_MIN = 16;
+
   InternalNode(ExecTree* exectree_);
   virtual bool struct_eq(const Node& other) const override;
 
@@ -115,11 +183,9 @@ class InternalNode : public Node {
   std::optional<CondType> get_children_condtype() const;
   void initialize_children_cond(CondType condtype);
 
-  virtual std::pair<Node*, ExecPath> find(ExecPath epath) override;
+  virtual std::pair<Node*, ExecPathView> find(ExecPathView epath) override;
   virtual bool is_internal() const override;
   virtual bool is_leaf() const override;
-  virtual void update_enum_bvs() override;
-  virtual void update_depth() override;
 
   virtual void filter_nd_pcid(TracePC* tpc, size_t prefix_len_so_far,
                               std::set<Node*>& filtered_nodes) override;
@@ -132,15 +198,33 @@ class InternalNode : public Node {
 
  private:
   virtual std::set<Input> get_inputset() override;
+  void gather_inputset(std::set<Input>& gathered);
+  virtual void refresh_aggregates() const override;
+  void invalidate_aggregates();
   Node* lookup_child(PCID pcid);
-  Node* lookup_child(ExecPath prefix_);
+  Node* lookup_child(ExecPathView prefix_);
+  std::unique_ptr<Node> remove_child(Node* node);
+  void reindex_children();
 
+  // Sorted by the first PCID of prefixes, unless `children_dirty`.
   std::vector<std::unique_ptr<Node>> children;
+  std::unordered_map<PCID, Node*> child_index;
+  // Set when filtering or adding children may have broken the order, and
+  // cleared by ExecTree::sort. Lookups scan linearly in the meantime.
+  bool children_dirty = false;
+
+  // Invalidated along the parent chain up to the first invalid ancestor, so
+  // that nodes below a valid one are valid too.
+  mutable bool aggregates_valid = false;
+  // Inputs of the subtree, gathered on demand and kept while valid.
+  std::optional<std::set<Input>> inputset_summary;
 
   // TODO: remove this workaround
   friend class Node;
+  friend class LeafNode;
   friend class ExecTree;
   friend class Engine;
+  friend class Snapshot;
 };
 
 InternalNode* as_internal(Node* node);
@@ -149,47 +233,94 @@ const InternalNode* as_internal(const Node* node);
 LeafNode* as_leaf(Node* node);
 const LeafNode* as_leaf(const Node* node);
 
+// A path and the inputs that ran it, to be inserted in bulk.
+struct PathEntry {
+  ExecPath epath;
+  std::set<Input> inputset;
+  int run_status;
+};
+
 class ExecTree {
  public:
   ExecTree(TracePC* tpc_);
   bool is_empty() const;
   void set_root(std::unique_ptr<Node> root_);
   Node* get_root() const;
-  Node* insert(ExecPath epath, Input input, int run_status);
-  Node* insert(ExecPath epath, std::set<Input> inputset, int run_status);
-  void purge_and_reinsert(ExecPath epath_old, ExecPath epath_new);
-  const std::set<InternalNode*>& get_internals() const;
-  const std::set<LeafNode*>& get_leaves() const;
-  Node* find(ExecPath epath);
-  bool has(ExecPath epath);
+  Node* insert(ExecPathView epath, Input input, int run_status,
+               bool must_keep = false);
+  Node* insert(ExecPathView epath, std::set<Input> inputset, int run_status,
+               bool must_keep = false);
+  void bulk_insert(std::vector<PathEntry> entries);
+  void purge_and_reinsert(ExecPathView epath_old, ExecPathView epath_new);
+  const std::vector<InternalNode*>& get_internals() const;
+  const std::vector<LeafNode*>& get_leaves() const;
+  Node* find(ExecPathView epath);
+  LeafNode* find_leaf(ExecPathView epath, uint64_t path_hash);
+  bool has(ExecPathView epath);
+  bool has(ExecPathView epath, uint64_t path_hash);
   bool has(Input input);
   LeafNode* get_leaf(Input input);
   ExecPath get_path(Input input);
-  std::vector<Node*> get_nodes(ExecPath epath);
-  std::set<Node*> evaluate_conditions(Input input, ExecPath epath);
+  std::vector<Node*> get_nodes(ExecPathView epath);
+  std::set<Node*> evaluate_conditions(Input input, ExecPathView epath);
   std::set<Node*> invalid_condition_nodes() const;
   void prune();
   bool is_sorted() const;
   size_t total_prefix_length() const;
   size_t num_total_input() const;
+  size_t resident_size() const;
+  size_t spilled_size() const;
   std::string to_string(bool print_epath = false) const;
 
  private:
-  std::unique_ptr<LeafNode> create_leaf(ExecPath prefix);
-  std::unique_ptr<InternalNode> create_internal(ExecPath prefix);
+  std::unique_ptr<LeafNode> create_leaf(ExecPathView prefix);
+  std::unique_ptr<InternalNode> create_internal(ExecPathView prefix);
   Node* add_node(std::unique_ptr<Node> node, InternalNode* parent,
                  std::unique_ptr<BranchCondition> cond = nullptr);
   void add_nodes(std::vector<std::unique_ptr<Node>> nodes,
                  InternalNode* parent);
   std::unique_ptr<Node> pull_node(Node* node);
   std::vector<std::unique_ptr<Node>> pull_children(Node* node);
-  std::unique_ptr<Node> purge_leaf(ExecPath epath);
-
-  std::set<Node*> get_all_nodes() const;
+  Node* insert_leaf(ExecPathView epath, std::set<Input> inputset,
+                    int run_status, bool must_keep);
+  std::unique_ptr<Node> purge_leaf(ExecPathView epath);
+  std::unique_ptr<Node> build_subtree(std::vector<PathEntry>& entries,
+                                      const std::vector<size_t>& group_begin,
+                                      size_t lo, size_t hi, size_t offset);
+
+  bool is_path_of(const LeafNode* leaf, ExecPathView epath) const;
+  void index_path(LeafNode* leaf, uint64_t path_hash);
+  void unindex_path(LeafNode* leaf);
+  void rebuild_path_index();
+
+  void index_pcids(Node* node, ExecPathView epath);
+  void rebuild_pcid_index();
+  bool contains_pcid(Node* node, PCID pcid) const;
+  std::vector<Node*> lookup_pcid(PCID pcid);
+  void collect_leaves(Node* node, std::set<uint32_t>& leaf_ids) const;
+
+  PrefixSlice intern_prefix(ExecPathView prefix);
+  void compact_prefix_pool();
+
+  void account(LeafNode* leaf);
+  void spill(LeafNode* leaf);
+  void page_in(LeafNode* leaf);
+  void free_spill_record(LeafNode* leaf);
+  void enforce_memory_budget();
+  ExecPathView spilled_tail(const LeafNode* leaf) const;
+  std::set<Input> spilled_inputset(const LeafNode* leaf) const;
+  bool spilled_has(const LeafNode* leaf, const Input& input) const;
+  void index_input(const Input& input, LeafNode* leaf);
+  LeafNode* leaf_of(const Input& input) const;
+
+  void register_node(Node* node);
+  void unregister_node(Node* node);
+  std::vector<Node*> get_all_nodes() const;
   bool has(Node* node) const;
+  bool has_id(uint32_t id) const;
 
   void rm_internal_epsilon_node(InternalNode* internal);
-  std::set<Node*> sort(InternalNode* internal);
+  std::set<uint32_t> sort(InternalNode* internal);
   std::unique_ptr<Node> merge(std::unique_ptr<Node> left,
                               std::unique_ptr<Node> right);
   void rm_internal_with_only_child(InternalNode* internal);
@@ -202,18 +333,51 @@ class ExecTree {
   TracePC* tpc;
 
   std::unique_ptr<Node> root;
-  std::set<InternalNode*> internals;
-  std::set<LeafNode*> leaves;
-  size_t height = 0;  // = max depth
-
-  // Set of all inputs.
-  // Used for checking conflict.
-  std::map<Input, LeafNode*> all_input;
+  std::vector<InternalNode*> internals;
+  std::vector<LeafNode*> leaves;
+  std::vector<Node*> node_of_id;  // nullptr if not in the tree
+
+  // Prefixes of all nodes. Starts with Node::EPSILON, which is shared by
+  // every epsilon prefix. Compacted when dead slices take up most of it.
+  ExecPath prefix_pool;
+  size_t compacted_pool_size = 0;
+
+  // Leaves of all resident inputs, by input id.
+  // Used for checking conflict. Entries hold their input, so that its id is
+  // not reused while it is in the tree.
+  struct InputEntry {
+    Input input;
+    LeafNode* leaf = nullptr;
+  };
+  std::unordered_map<uint32_t, InputEntry> all_input;
+  // Leaves of spilled inputs, by hash of their arguments. Spilled inputs are
+  // released from the input store, and interned again once paged in.
+  std::unordered_multimap<uint64_t, LeafNode*> spilled_input;
+
+  // Hash of significant path to leaves.
+  // Used for checking duplicate path without walking the tree.
+  std::unordered_multimap<uint64_t, LeafNode*> path_index;
+
+  // PCID to ids of nodes whose prefix or tail contained it. Entries are only
+  // appended, so they are checked against the node on lookup.
+  // Used for pruning only the nodes affected by new nondeterministic PCs.
+  std::vector<std::vector<uint32_t>> pcid_index;
+  size_t pcid_index_size = 0;
+  size_t rebuilt_pcid_index_size = 0;
+  size_t num_nd_pruned = 0;
+
+  // Input sets and tails of least recently used leaves are spilled to
+  // `spill_file` once `resident_bytes` exceeds `MEMORY_BUDGET`.
+  std::unique_ptr<SpillFile> spill_file;
+  size_t resident_bytes = 0;
+  size_t use_clock = 0;
 
   friend class Node;
   friend class LeafNode;
   friend class InternalNode;
   friend class Engine;
+  friend class Scheduler;
+  friend class Snapshot;
   friend bool struct_eq(const ExecTree& left, const ExecTree& right);
 };
 
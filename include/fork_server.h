@@ -0,0 +1,28 @@
+#ifndef PATHFINDER_FORK_SERVER
+#define PATHFINDER_FORK_SERVER
+
+#include "pathfinder_defs.h"
+#include "trace_pc.h"
+
+namespace pathfinder {
+
+// Runs each input in a child forked from this process, so that a crash or
+// a hang of the target only ends the child. The first input is run
+// in-process, so that lazy initialization of the target library is done
+// once and inherited by every child.
+class ForkServer {
+ public:
+  ForkServer(UserCallback callback_, TracePC* tpc_);
+  ~ForkServer();
+  int run(const Input& input, unsigned timeout);
+
+ private:
+  UserCallback callback;
+  TracePC* tpc;
+  int* run_status;  // written by the child, in memory shared with it
+  bool ready = false;
+};
+
+}  // namespace pathfinder
+
+#endif
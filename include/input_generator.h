@@ -1,6 +1,8 @@
 #ifndef PATHFINDER_INPUT_GENERATOR
 #define PATHFINDER_INPUT_GENERATOR
 
+#include <deque>
+
 #include "enum_solver.h"
 #include "numeric_solver.h"
 #include "pathfinder_defs.h"
@@ -12,11 +14,21 @@ class InputGenerator {
   InputGenerator();
   void set_condition(std::vector<EnumCondition*> enum_conditions,
                      std::vector<NumericCondition*> numeric_conditions);
+  void set_flips(std::vector<Flip> path_);
   std::optional<Input> gen();
+  bool is_unsat() const;
 
  private:
+  void gen_flips();
+
   std::unique_ptr<EnumSolver> enum_solver;
   std::unique_ptr<NumericSolver> numeric_solver;
+
+  // Set in generational search, where inputs are drawn a batch at a time,
+  // one for each query on `path`.
+  std::optional<std::vector<Flip>> path;
+  std::deque<Input> flipped_inputs;
+  bool drew_flips = false;
 };
 
 }  // namespace pathfinder
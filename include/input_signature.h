@@ -55,11 +55,14 @@ class InputSignature {
   std::vector<std::vector<EnumParam>> enum_param_groups;
   std::vector<NumericParam> numeric_params;
   std::set<std::string> name_set;
-
-  friend void register_enum_param(std::string name,
-                                  std::vector<std::string> entries);
-  friend void register_enum_param(std::string name, size_t size, size_t start);
-  friend void register_int_param(std::string name);
+  std::vector<std::string> param_names;  // by parameter id
+
+  friend EnumArg register_enum_param(std::string name,
+                                     std::vector<std::string> entries);
+  friend EnumArg register_enum_param(std::string name, size_t size,
+                                     size_t start);
+  friend IntArg register_int_param(std::string name);
+  friend const std::vector<std::string>& get_param_names();
   friend size_t size();
   friend size_t enum_params_size();
   friend size_t int_params_size();
@@ -75,15 +78,17 @@ class InputSignature {
   friend std::optional<Input> deserialize(const std::vector<long>& data);
 };
 
-void register_enum_param(std::string name, std::vector<std::string> entries);
-void register_enum_param(std::string name, size_t start, size_t size);
-void register_int_param(std::string name);
+EnumArg register_enum_param(std::string name,
+                            std::vector<std::string> entries);
+EnumArg register_enum_param(std::string name, size_t start, size_t size);
+IntArg register_int_param(std::string name);
 size_t enum_params_size();
 size_t int_params_size();
 size_t params_size();
 const std::vector<EnumParam>& get_enum_params();
 const std::vector<std::vector<EnumParam>>& get_enum_param_groups();
 const std::vector<NumericParam>& get_numeric_params();
+const std::vector<std::string>& get_param_names();
 std::vector<std::string> get_enum_param_names();
 std::vector<std::string> get_numeric_param_names();
 long enum_value_at(Args enum_args, size_t idx);
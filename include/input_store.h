@@ -0,0 +1,48 @@
+#ifndef PATHFINDER_INPUT_STORE
+#define PATHFINDER_INPUT_STORE
+
+#include <deque>
+#include <unordered_map>
+
+#include "pathfinder_defs.h"
+
+namespace pathfinder {
+
+// Stores each distinct input once. `Input`s are reference counted ids into
+// it, so that copying and comparing them does not touch their arguments.
+class InputStore {
+ public:
+  static const uint32_t EMPTY_ID = 0;
+
+  InputStore();
+  uint32_t intern(Args enum_args, Args numeric_args);
+  void retain(uint32_t id);
+  void release(uint32_t id);
+  const Args& get_enum_args(uint32_t id) const;
+  const Args& get_numeric_args(uint32_t id) const;
+  const long* get_values(uint32_t id) const;
+  uint64_t get_hash(uint32_t id) const;
+  size_t size() const;
+
+ private:
+  struct Entry {
+    Args enum_args;
+    Args numeric_args;
+    std::vector<long> values;  // by parameter id
+    uint64_t hash;
+    uint32_t refcount;
+  };
+
+  static uint64_t hash_values(const std::vector<long>& values);
+
+  // Never shrinks, so that arguments of live entries are never moved.
+  std::deque<Entry> entries;
+  std::vector<uint32_t> free_ids;
+  std::unordered_multimap<uint64_t, uint32_t> id_of_hash;
+};
+
+InputStore& input_store();
+
+}  // namespace pathfinder
+
+#endif
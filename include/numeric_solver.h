@@ -52,15 +52,15 @@ class Solver {
  public:
   Solver();
   bool is_satisfiable();
+  void clear_history();
 
  protected:
   z3::context* get_ctx() const;
   z3::solver* get_solver() const;
-  void clear_history();
   void reset();
   void assign(const z3::model& m);
   std::unique_ptr<z3::expr> current_assignment();
-  std::optional<Args> draw();
+  std::optional<Args> draw(const std::vector<z3::expr>& assumptions = {});
   Args get_args();
   std::vector<std::unique_ptr<SolverVar>> solver_vars;
   std::unique_ptr<z3::expr> history;
@@ -70,20 +70,47 @@ class Solver {
   std::unique_ptr<z3::solver> s;
 };
 
+// A node on the path of a generational search. Inputs leaving the path there
+// satisfy the conditions of the nodes above, and instead of `cond`, either
+// its negation or the condition of `sibling`.
+struct Flip {
+  BranchCondition* cond;
+  BranchCondition* sibling = nullptr;
+  bool negate = false;
+
+  bool is_query() const;
+};
+
+// Keeps one solver across conditions, so that what it learned carries over
+// from path to path. Each condition is added once, equated with a guard
+// literal, and paths are solved assuming the guards of their conditions.
 class NumericSolver : public Solver {
  public:
+  static const size_t MAX_GUARDS;
+
   NumericSolver();
   void set_condition(std::vector<NumericCondition*> numeric_conditions,
                      bool conform_soft);
   std::optional<Args> draw();
+  std::vector<std::optional<Args>> draw_flips(const std::vector<Flip>& path);
 
  private:
-  void reset(bool conform_soft);
+  void reset();
+  std::optional<z3::expr> guard(BranchCondition* cond);
   z3::expr rand_constraint();
 
   std::unique_ptr<z3::expr> basic_constraint;
   std::unique_ptr<z3::expr> hard_constraint;
   std::unique_ptr<z3::expr> soft_constraint;
+  std::unique_ptr<z3::expr> soft_guard;
+
+  // By serial of the condition, as conditions are never changed once set.
+  // Cleared along with the solver once too many, as conditions are replaced
+  // by refinement.
+  std::map<uint64_t, z3::expr> guards;
+  std::vector<z3::expr> assumptions;
+
+  friend class SolverTest;
 };
 
 }  // namespace pathfinder
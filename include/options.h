@@ -3,6 +3,7 @@
 
 #include <filesystem>
 #include <string>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -10,6 +11,26 @@ namespace pathfinder {
 
 enum SCHEDULE {
   SCHEDULE_RAND,
+  SCHEDULE_RARITY,
+  SCHEDULE_UCB,
+  SCHEDULE_COST,
+};
+
+enum SEARCH {
+  SEARCH_PATH,
+  SEARCH_GENERATIONAL,
+};
+
+enum DIFF_ALGORITHM {
+  DIFF_MYERS,
+  DIFF_PATIENCE,
+};
+
+enum THREAD_POLICY {
+  THREAD_SHARED,
+  THREAD_MAIN,
+  THREAD_CONCAT,
+  THREAD_MERGE,
 };
 
 enum VERBOSE_LEVEL {
@@ -25,6 +46,9 @@ extern fs::path CORPUS;
 extern bool OUTPUT_UNIQUE;
 extern std::string COV_OUTPUT_FILENAME;
 extern std::string STAT_OUTPUT_FILENAME;
+extern std::string SNAPSHOT_FILENAME;
+extern size_t SNAPSHOT_INTERVAL;
+extern std::string RESUME_FILENAME;
 extern bool COLORIZE_OUTPUT;
 
 extern bool RUN_ONLY;
@@ -37,6 +61,7 @@ extern std::string CMD_LINE_CONSTRAINT;
 extern bool IGNORE_EXCEPTION;
 
 extern SCHEDULE SCHEDULING_STRATEGY;
+extern SEARCH SEARCH_STRATEGY;
 extern int ARG_INT_MIN;
 extern int ARG_INT_MAX;
 extern int MAX_GEN_PER_ITER;
@@ -44,11 +69,21 @@ extern size_t MAX_TIME_PER_ITER;
 extern float MUT_RATE;
 extern float COND_ACCURACY_THRESHOLD;
 extern bool WO_NBP;
+extern DIFF_ALGORITHM DIFF;
+extern size_t ND_VOTE_RUNS;
+extern THREAD_POLICY TRACE_THREAD_POLICY;
+extern std::string PC_ALLOWLIST;
+extern std::string PC_DENYLIST;
+extern size_t CMP_LITERALS;
 
 extern bool BLACKBOX;
 extern int MAX_ITER;
 extern VERBOSE_LEVEL V_LEVEL;
 extern unsigned CALLBACK_TIMEOUT;
+extern bool FORK_SERVER;
+extern size_t LOOP_MAX_PERIOD;
+extern std::vector<size_t> LOOP_BUCKETS;
+extern size_t MEMORY_BUDGET;
 extern size_t MAX_TOTAL_TIME;
 extern size_t MAX_TOTAL_GEN;
 extern size_t COV_INTERVAL_TIME;
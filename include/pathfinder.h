@@ -16,10 +16,12 @@
 
 extern bool is_initial_seed;
 
-void PathFinderEnumArg(std::string name, std::vector<std::string> entries);
-void PathFinderEnumArg(std::string name, size_t start, size_t size);
-void PathFinderEnumArg(std::string name, size_t size);
-void PathFinderIntArg(std::string name);
+pathfinder::EnumArg PathFinderEnumArg(std::string name,
+                                      std::vector<std::string> entries);
+pathfinder::EnumArg PathFinderEnumArg(std::string name, size_t start,
+                                      size_t size);
+pathfinder::EnumArg PathFinderEnumArg(std::string name, size_t size);
+pathfinder::IntArg PathFinderIntArg(std::string name);
 void PathFinderAddHardConstraint(pathfinder::BoolExpr ctr);
 void PathFinderAddHardConstraint(std::vector<pathfinder::BoolExpr> ctrs);
 void PathFinderAddSoftConstraint(pathfinder::BoolExpr ctr);
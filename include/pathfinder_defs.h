@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <string>
@@ -14,33 +15,89 @@ namespace pathfinder {
 typedef uint32_t PCID;
 typedef std::vector<PCID> ExecPath;  // Execution path
 
+// Non-owning view of an execution path.
+// Valid as long as the viewed buffer is, e.g., until the next execution
+// for a view of the path log.
+class ExecPathView {
+ public:
+  typedef const PCID* iterator;
+  typedef const PCID* const_iterator;
+  typedef PCID value_type;
+
+  ExecPathView() : ptr(nullptr), len(0) {}
+  ExecPathView(const PCID* ptr_, size_t len_) : ptr(ptr_), len(len_) {}
+  ExecPathView(const ExecPath& epath)
+      : ptr(epath.data()), len(epath.size()) {}
+  const PCID* data() const { return ptr; }
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+  const PCID& operator[](size_t idx) const { return ptr[idx]; }
+  iterator begin() const { return ptr; }
+  iterator end() const { return ptr + len; }
+  ExecPathView subview(size_t start) const {
+    return ExecPathView(ptr + start, len - start);
+  }
+  ExecPathView subview(size_t start, size_t len_) const {
+    return ExecPathView(ptr + start, len_);
+  }
+  ExecPath to_vec() const { return ExecPath(begin(), end()); }
+
+ private:
+  const PCID* ptr;
+  size_t len;
+};
+
+inline bool operator==(ExecPathView left, ExecPathView right) {
+  return left.size() == right.size() &&
+         std::equal(left.begin(), left.end(), right.begin());
+}
+inline bool operator!=(ExecPathView left, ExecPathView right) {
+  return !(left == right);
+}
+inline size_t common_prefix_length(ExecPathView left, ExecPathView right) {
+  size_t i = 0;
+  while (i < left.size() && i < right.size() && left[i] == right[i]) i++;
+  return i;
+}
+
 typedef std::map<std::string, long> Args;
 
+// Handles of arguments, returned when registering them. Index the argument
+// values of an input by registration order, without looking up names.
+struct IntArg {
+  uint32_t param_id = 0;
+};
+struct EnumArg {
+  uint32_t param_id = 0;
+};
+
+// Handle of an input interned in the input store. Inputs of the same
+// arguments share an id, which is all that copies and comparisons touch.
 class Input {
  public:
-  Input() {};
-  Input(Args enum_args_, Args numeric_args_)
-      : enum_args(enum_args_), numeric_args(numeric_args_) {}
-  const Args& get_enum_args() const { return enum_args; }
-  const Args& get_numeric_args() const { return numeric_args; }
-  bool operator<(const Input& other) const {
-    if (enum_args < other.enum_args)
-      return true;
-    else if (other.enum_args < enum_args)
-      return false;
-    else
-      return numeric_args < other.numeric_args;
-  }
-  long operator[](std::string key) const {
-    if (enum_args.find(key) != enum_args.end())
-      return enum_args.at(key);
-    else
-      return numeric_args.at(key);
-  }
+  Input();
+  Input(Args enum_args_, Args numeric_args_);
+  Input(const Input& other);
+  Input(Input&& other);
+  Input& operator=(const Input& other);
+  Input& operator=(Input&& other);
+  ~Input();
+  const Args& get_enum_args() const;
+  const Args& get_numeric_args() const;
+  uint32_t get_id() const { return id; }
+  uint64_t get_hash() const;
+  long operator[](IntArg arg) const { return values[arg.param_id]; }
+  long operator[](EnumArg arg) const { return values[arg.param_id]; }
+  bool operator<(const Input& other) const { return id < other.id; }
+  bool operator==(const Input& other) const { return id == other.id; }
+  bool operator!=(const Input& other) const { return id != other.id; }
+  long operator[](const std::string& key) const;
 
  private:
-  Args enum_args;
-  Args numeric_args;
+  void set_id(uint32_t id_);
+
+  uint32_t id;
+  const long* values;  // in the input store, by parameter id
 };
 
 enum CondType {
@@ -57,6 +114,10 @@ int driver(UserCallback Callback);
 const int PATHFINDER_PASS = -1;
 const int PATHFINDER_EXPECTED_EXCEPTION = -2;
 const int PATHFINDER_UNEXPECTED_EXCEPTION = -3;
+// Only reported in fork server mode, where a crashing or hanging execution
+// terminates the forked child instead of PathFinder itself.
+const int PATHFINDER_CRASH = -4;
+const int PATHFINDER_TIMEOUT = -5;
 
 }  // namespace pathfinder
 
@@ -0,0 +1,81 @@
+#ifndef PATHFINDER_SCHEDULER
+#define PATHFINDER_SCHEDULER
+
+#include "exectree.h"
+
+namespace pathfinder {
+
+// Sums of weights indexed by position, for sampling a position with
+// probability proportional to its weight in O(log n).
+class WeightTree {
+ public:
+  void resize(size_t size);
+  void set(size_t idx, double weight);
+  double get(size_t idx) const;
+  double total() const;
+  size_t find(double value) const;
+  size_t size() const;
+
+ private:
+  double prefix(size_t size) const;
+
+  std::vector<double> weights;
+  std::vector<double> tree = {0};  // 1-based Fenwick tree over `weights`
+};
+
+// Picks leaves to generate inputs for, and learns from what came of them.
+// Statistics are kept by node id, as leaves may be removed from the tree
+// at any time.
+//
+// Leaves for which no input could be generated are quarantined for
+// exponentially longer, until a condition on their path is replaced.
+class Scheduler {
+ public:
+  Scheduler(ExecTree* exectree_);
+  LeafNode* schedule();
+  void report_hit(LeafNode* leaf);
+  void report_new_path();
+  void report_counterexample();
+  void report_failure();
+  void report_run(LeafNode* leaf, size_t latency, size_t path_length);
+
+ private:
+  struct LeafStats {
+    size_t num_selected = 0;
+    size_t num_hits = 0;  // generated inputs that ran its path
+    size_t num_new_paths = 0;
+    size_t num_counterexamples = 0;
+    size_t num_failures = 0;  // conditions without inputs to generate
+
+    // Of the conditions it last failed with, and how often it failed with
+    // them in a row.
+    uint64_t failed_fingerprint = 0;
+    size_t num_backoffs = 0;
+    size_t quarantined_until = 0;  // in `num_selected`
+  };
+
+  LeafNode* pick();
+  LeafNode* sample();
+  bool is_quarantined(LeafNode* leaf);
+  uint64_t fingerprint(LeafNode* leaf) const;
+  void sync_leaves();
+  void rebuild();
+  double weight(uint32_t id) const;
+  void update(uint32_t id);
+
+  ExecTree* exectree;
+  std::vector<LeafStats> stats;
+  WeightTree weights;
+  std::optional<uint32_t> last_scheduled;
+  size_t num_selected = 0;
+  // Weights depend on `num_selected` through UCB, and drift as they are
+  // updated. Both are fixed by rebuilding when it doubles.
+  size_t num_selected_at_rebuild = 0;
+  // Of all runs reported, standing in for leaves not run yet.
+  size_t total_latency = 0;
+  size_t num_runs = 0;
+};
+
+}  // namespace pathfinder
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef PATHFINDER_SNAPSHOT
+#define PATHFINDER_SNAPSHOT
+
+#include "exectree.h"
+
+namespace pathfinder {
+
+// Versioned binary snapshot of a path tree, including conditions of nodes,
+// and of nondeterministic and covered PCs, for resuming a campaign.
+class Snapshot {
+ public:
+  static const uint32_t VERSION;
+
+  static void save(const std::string& filename, const ExecTree& exectree,
+                   TracePC* tpc);
+  static void load(const std::string& filename, ExecTree& exectree,
+                   TracePC* tpc);
+
+ private:
+  class Writer;
+  class Reader;
+
+  static void save_node(Writer& writer, const Node* node);
+  static void save_cond(Writer& writer, const BranchCondition* cond);
+  static void load_node(Reader& reader, ExecTree& exectree,
+                        InternalNode* parent);
+  static std::unique_ptr<BranchCondition> load_cond(Reader& reader);
+};
+
+}  // namespace pathfinder
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef PATHFINDER_SPILL_FILE
+#define PATHFINDER_SPILL_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace pathfinder {
+
+// Temporary file of words, mapped for reading. Records are never moved, so
+// pointers into them stay valid until they are freed. Freed records are
+// reused by later ones, so the file only grows past what is in use by the
+// fragmentation left between them.
+class SpillFile {
+ public:
+  // Size of the mapping reserved up front. The file is never remapped.
+  static const size_t MAX_SIZE = (size_t)1 << 38;
+
+  SpillFile();
+  ~SpillFile();
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+  uint64_t write(const std::vector<uint32_t>& words);
+  void free(uint64_t offset, size_t size);
+  const uint32_t* at(uint64_t offset) const;
+  size_t size() const;
+
+ private:
+  void add_free_range(uint64_t offset, size_t size);
+  void remove_free_range(std::map<uint64_t, size_t>::iterator it);
+
+  int fd;
+  const uint32_t* mapping;
+  size_t num_words = 0;  // including free ranges
+  // Free ranges, coalesced, by offset and by size for best fit.
+  std::map<uint64_t, size_t> free_ranges;
+  std::set<std::pair<size_t, uint64_t>> free_sizes;
+};
+
+}  // namespace pathfinder
+
+#endif
@@ -75,6 +75,8 @@ class SygusFile {
 };
 
 extern const std::set<int> default_literals;
+void count_literals(const std::vector<int>& literals);
+std::set<int> grammar_literals();
 
 std::unique_ptr<SygusFile> gen_sygus_file(
     CondType condtype, std::vector<std::unique_ptr<Constraint>> constraints);
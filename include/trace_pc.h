@@ -1,13 +1,21 @@
 #ifndef PATHFINDER_TRACE_PC
 #define PATHFINDER_TRACE_PC
 
+#include <sys/mman.h>
+
+#include <atomic>
 #include <bitset>
 #include <cassert>
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_set>
 #include <vector>
 
+#include "options.h"
 #include "pathfinder_defs.h"
 
 namespace pathfinder {
@@ -21,24 +29,44 @@ class TracePC {
     BitMap() {
       bitmap = nullptr;
       size = 0;
+      shared = false;
     }
-    ~BitMap() {
-      if (bitmap != nullptr) delete[] bitmap;
-    }
+    ~BitMap() { release(); }
     bool is_available() { return bitmap != nullptr; }
-    void init(size_t size_) {
+    void init(size_t size_, bool shared_ = false) {
       size = size_;
-      size_t bytesize = size % 8 == 0 ? size / 8 : size / 8 + 1;
-      size_t alligned_size =
-          bytesize % 8 == 0 ? bytesize : (bytesize / 8 + 1) * 8;
-      bitmap = new uint8_t[alligned_size];
-      memset(bitmap, 0, alligned_size);
+      shared = shared_;
+      if (shared) {
+        void* mem = mmap(nullptr, alligned_size(), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        assert(mem != MAP_FAILED);
+        bitmap = (uint8_t*)mem;
+      } else {
+        bitmap = new uint8_t[alligned_size()];
+      }
+      memset(bitmap, 0, alligned_size());
+    }
+    void share() {
+      // Move the bitmap into shared memory, keeping bits already set.
+      if (shared || !is_available()) return;
+      uint8_t* old_bitmap = bitmap;
+      init(size, true);
+      memcpy(bitmap, old_bitmap, alligned_size());
+      delete[] old_bitmap;
     }
     inline void set(size_t idx) {
       size_t byteidx = idx / 8;
       size_t bitidx = idx % 8;
       bitmap[byteidx] |= bitmask(bitidx);
     }
+    inline bool test_and_set(size_t idx) {
+      // Returns whether the bit is newly set, by this thread only.
+      size_t byteidx = idx / 8;
+      uint8_t mask = bitmask(idx % 8);
+      if (bitmap[byteidx] & mask) return false;
+      return !(__atomic_fetch_or(&bitmap[byteidx], mask, __ATOMIC_RELAXED) &
+               mask);
+    }
     inline bool is_set(size_t idx) {
       size_t byteidx = idx / 8;
       size_t bitidx = idx % 8;
@@ -57,6 +85,18 @@ class TracePC {
     }
 
    private:
+    size_t alligned_size() const {
+      size_t bytesize = size % 8 == 0 ? size / 8 : size / 8 + 1;
+      return bytesize % 8 == 0 ? bytesize : (bytesize / 8 + 1) * 8;
+    }
+    void release() {
+      if (bitmap == nullptr) return;
+      if (shared)
+        munmap(bitmap, alligned_size());
+      else
+        delete[] bitmap;
+      bitmap = nullptr;
+    }
     inline uint8_t bitmask(size_t bitidx) {
       uint8_t mask;
       switch (bitidx) {
@@ -90,30 +130,88 @@ class TracePC {
 
     uint8_t* bitmap;
     size_t size;
+    bool shared;
   };
 
+  // Result of the current execution. In fork server mode this lives in
+  // shared memory along with the path log and the coverage bitmap, so that
+  // the parent can read what a forked child has recorded.
+  struct RunState {
+    size_t path_log_size;
+    uint64_t path_hash;  // over the significant part of the path log
+    size_t num_covered;
+    size_t num_new_covered;  // PCs covered first in this execution
+    size_t num_cmp_literals;
+    int cmp_literals[64];  // distinct constant operands of comparisons
+  };
+  static const int MAX_CMP_LITERAL = 1024;
+
+  // Path log of a thread other than the one tracing target function, under
+  // THREAD_CONCAT and THREAD_MERGE. Owned by `TracePC` so that PCs of a
+  // thread exited before `TraceOff` are not lost. Only the thread appends,
+  // without locking, and publishes `epoch` and `size` by release stores for
+  // `MergeThreadLogs` to read. Chunks are added as the log grows, never
+  // moved, and reused across epochs.
+  struct ThreadTrace {
+    static const size_t CHUNK_SIZE = 1024;
+    struct Chunk {
+      PCID pcids[CHUNK_SIZE];
+      std::unique_ptr<Chunk> next;
+    };
+    std::atomic<size_t> epoch;
+    std::atomic<size_t> size;
+    Chunk head;
+    Chunk* cursor;  // the chunk of the next PC, used by the thread only
+    std::atomic<bool> exited;
+  };
+
+  static const uint64_t PATH_HASH_SEED = 0xcbf29ce484222325ULL;
+  static inline uint64_t HashPCID(uint64_t hash, PCID pcid) {
+    hash = (hash ^ pcid) * 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 29);
+  }
+
  public:
   TracePC(size_t max_significant_execpath_size_ = 1000000);
   ~TracePC();
   void HandleInit(uint32_t* Start, uint32_t* Stop);
+  void HandlePCsInit(const uintptr_t* PCsBeg, const uintptr_t* PCsEnd);
+  size_t FilterPCs(const std::vector<std::string>& allowlist,
+                   const std::vector<std::string>& denylist);
   size_t ExecPathSignificantMax() const;
-  ExecPath significant(ExecPath epath) const;
-  ExecPath tail_of(ExecPath epath) const;
-  bool eq_significant(const ExecPath& left, const ExecPath& right) const;
-  bool truncated(const ExecPath& epath) const;
-  bool considerably_longer(const ExecPath& left, const ExecPath& right) const;
+  ExecPathView significant(ExecPathView epath) const;
+  ExecPathView tail_of(ExecPathView epath) const;
+  bool eq_significant(ExecPathView left, ExecPathView right) const;
+  bool truncated(ExecPathView epath) const;
+  bool considerably_longer(ExecPathView left, ExecPathView right) const;
+  uint64_t PathHash(ExecPathView epath) const;
   void TraceOn();
   void TraceOff();
   void ClearPathLog();
+  void MapSharedMemory();
   void AppendPathLog(PCID pcid);
-  void CheckDiff(ExecPath left, ExecPath right);
-  ExecPath Prune(ExecPath epath);
+  void SetLoopCompression(size_t max_period,
+                          const std::vector<size_t>& buckets);
+  void SetPatienceDiff(bool patience);
+  void SetThreadPolicy(THREAD_POLICY policy);
+  void CollectCmpLiterals(bool collect);
+  void HandleConstCmp(uint64_t value, size_t width);
+  std::vector<int> GetCmpLiterals() const;
+  void CheckDiff(ExecPathView left, ExecPathView right);
+  ExecPath Prune(ExecPathView epath);
   ExecPath GetPathLog();
+  ExecPathView GetPathLogView() const;
+  uint64_t GetPathHash() const;
   size_t GetNumInstrumented();
   void InitCoveredBitMap();
   size_t GetNumCovered();
+  ExecPathView GetNewCovered() const;
   size_t GetNumND();
+  ExecPathView GetNewND(size_t num_seen) const;
   void AddND(const ExecPath& epath);
+  void ClearVotes();
+  void Vote(ExecPathView epath);
+  size_t AddNDByVotes();
 
  private:
   size_t ExecPathTailMax() const;
@@ -121,25 +219,94 @@ class TracePC {
   size_t CheckDiffChunkSize() const;
   void InitNDBitMap();
   bool IsND(PCID pcid);
-  void CheckDiff(ExecPath& left, size_t left_start, size_t left_size,
-                 ExecPath& right, size_t right_start, size_t right_size,
+  void MarkND(PCID pcid);
+  std::tuple<size_t, size_t, size_t, size_t, size_t> FindMiddleSnake(
+      const ExecPath& left, size_t left_start, size_t left_size,
+      const ExecPath& right, size_t right_start, size_t right_size);
+  void MyersDiff(const ExecPath& left, size_t left_start, size_t left_size,
+                 const ExecPath& right, size_t right_start, size_t right_size,
                  std::vector<bool>& shadow_left,
                  std::vector<bool>& shadow_right);
+  void PatienceDiff(const ExecPath& left, size_t left_start,
+                    size_t left_size, const ExecPath& right,
+                    size_t right_start, size_t right_size,
+                    std::vector<bool>& shadow_left,
+                    std::vector<bool>& shadow_right);
+  void CollectChunk(ExecPathView epath, size_t start, ExecPath& chunk,
+                    size_t limit);
   void AddND(ExecPath& epath, std::vector<bool>& shadow_epath, bool do_all);
-  ExecPath Prune(PCID* epath, size_t size);
+  ExecPath Prune(const PCID* epath, size_t size);
+  void EmitPathLog(PCID pcid);
+  void AppendThreadLog(PCID pcid);
+  void MergeThreadLogs();
+  void AppendLoopCompressed(PCID pcid);
+  void ResetLoopState();
 
   // parameterized for being used in test
   size_t max_significant_execpath_size;
   size_t max_tail_execpath_size;
   size_t check_diff_chunk_size;
 
+  // Guards and PC table (`-fsanitize-coverage=pc-table`) of each module.
+  // Guards of filtered and nondeterministic PCs are patched to 0, on which
+  // the coverage callback returns right away.
+  struct Module {
+    uint32_t* start;
+    uint32_t* stop;
+    const uintptr_t* pcs;  // pairs of PC and flags, null without a PC table
+  };
+  std::vector<Module> modules;
+  std::vector<uint32_t*> guards;  // indexed by PCID - 1
+
   size_t NumGuards;
   BitMap covered_pc_bitmap;
   BitMap nondeterministic_pc_bitmap;
+  ExecPath nd_pcids;  // in order of being marked
+
+  // Loop compression. Once the last PCIDs repeat with a period of at most
+  // `loop_max_period`, further iterations of the loop body are recorded only
+  // when the iteration count hits one of `loop_buckets` (AFL-style hit count
+  // buckets), so that paths differing only in the number of iterations
+  // within a bucket are the same path. Disabled when `loop_max_period` is 0.
+  size_t loop_max_period;
+  std::vector<size_t> loop_buckets;
+  std::vector<PCID> loop_history;   // ring of the last uncompressed PCIDs
+  std::vector<size_t> loop_match;   // [p]: run length of history[t]==[t-p]
+  size_t loop_history_size;
+  size_t loop_period;  // period of the current loop, 0 if not in a loop
+  size_t loop_phase;   // position in the loop body of the next PCID
+  size_t loop_iter;    // completed iterations of the current loop
+  size_t loop_next_bucket;
+
+  // Per PC number of voted paths having it, to find PCs that do not show up
+  // in every run of the same input.
+  std::vector<uint32_t> vote_count;
+  std::vector<uint32_t> vote_stamp;  // last vote having the PC
+  std::vector<PCID> voted_pcids;
+  uint32_t num_votes;
+
+  THREAD_POLICY thread_policy;
+  std::thread::id main_thread;  // the one called `TraceOn`
+  std::atomic<size_t> epoch;    // advanced on every `ClearPathLog`
+  size_t merged_epoch;
+  // In order of the first PC of each thread.
+  std::vector<std::unique_ptr<ThreadTrace>> thread_traces;
+  std::mutex thread_traces_mutex;
+
+  // Buffers of `CheckDiff`, kept to be reused across calls.
+  bool patience_diff;
+  ExecPath diff_left, diff_right;
+  std::vector<bool> diff_shadow_left, diff_shadow_right;
+  std::vector<int> diff_forward, diff_backward;
+
+  bool collect_cmp_literals;
 
   PCID* PathLog;
-  size_t PathLogSize;
+  PCID* NewCovered;  // `num_new_covered` PCs, in order of first hit
+  RunState* state;
+  bool shared_memory;
   bool trace;
+  friend class Snapshot;
 };
 
 TracePC& TPC();
@@ -159,6 +159,11 @@ std::string vec_to_string(std::vector<T> arg) {
   return str;
 }
 
+template <typename T>
+const T& random_choice(const std::vector<T>& from) {
+  assert(!from.empty());
+  return from[std::rand() % from.size()];
+}
 template <typename T>
 T random_choice(std::set<T> from) {
   assert(!from.empty());
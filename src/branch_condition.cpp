@@ -61,14 +61,22 @@ std::string run_synthesizer(std::string sygus_file, float timeout) {
 }
 
 const size_t BranchCondition::MAX_SAMPLE_SIZE = 50;
-BranchCondition::BranchCondition(CondType condtype_) : condtype(condtype_) {
+uint64_t BranchCondition::next_serial = 0;
+BranchCondition::BranchCondition(CondType condtype_)
+    : condtype(condtype_), serial(next_serial++) {
   synthesis_budget = synthesis_budget_max();
 }
+BranchCondition::BranchCondition(const BranchCondition& other)
+    : cmat(other.cmat),
+      condtype(other.condtype),
+      synthesis_budget(other.synthesis_budget),
+      serial(next_serial++) {}
 bool BranchCondition::operator==(const BranchCondition& other) const {
   return condtype == other.condtype &&
          synthesis_budget == other.synthesis_budget && cmat == other.cmat;
 }
 CondType BranchCondition::get_condtype() const { return condtype; }
+uint64_t BranchCondition::get_serial() const { return serial; }
 bool BranchCondition::eval_and_update(const Input& input, bool ground_truth) {
   assert(!invalid());
 
@@ -307,6 +315,8 @@ BoolExpr* EnumCondition::get_equality_cond() const {
 }
 
 NumericCondition::NumericCondition() : BranchCondition(CT_NUMERIC) {}
+NumericCondition::NumericCondition(std::unique_ptr<BoolExpr> cond_)
+    : BranchCondition(CT_NUMERIC), cond(std::move(cond_)) {}
 NumericCondition::NumericCondition(const NumericCondition& other)
     : BranchCondition(other) {
   cond =
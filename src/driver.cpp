@@ -15,21 +15,23 @@ void PathFinderSetup();
 int PathFinderTestOneInput(const pathfinder::Input& input);
 }  // extern "C"
 
-void PathFinderEnumArg(std::string name, std::vector<std::string> entries) {
-  pathfinder::register_enum_param(name, entries);
+pathfinder::EnumArg PathFinderEnumArg(std::string name,
+                                      std::vector<std::string> entries) {
   pathfinder::register_enum_bv(name, entries);
+  return pathfinder::register_enum_param(name, entries);
 }
-void PathFinderEnumArg(std::string name, size_t start, size_t size) {
-  pathfinder::register_enum_param(name, start, size);
+pathfinder::EnumArg PathFinderEnumArg(std::string name, size_t start,
+                                      size_t size) {
   pathfinder::register_enum_bv(name, start, size);
+  return pathfinder::register_enum_param(name, start, size);
 }
-void PathFinderEnumArg(std::string name, size_t size) {
-  pathfinder::register_enum_param(name, 0, size);
+pathfinder::EnumArg PathFinderEnumArg(std::string name, size_t size) {
   pathfinder::register_enum_bv(name, 0, size);
+  return pathfinder::register_enum_param(name, 0, size);
 }
-void PathFinderIntArg(std::string name) {
-  pathfinder::register_int_param(name);
+pathfinder::IntArg PathFinderIntArg(std::string name) {
   pathfinder::register_sym_int_arg(name);
+  return pathfinder::register_int_param(name);
 }
 void PathFinderAddHardConstraint(pathfinder::BoolExpr ctr) {
   pathfinder::hard_constraints.push_back(
@@ -52,6 +54,28 @@ void PathFinderAddSoftConstraint(std::vector<pathfinder::BoolExpr> ctrs) {
 
 namespace pathfinder {
 
+std::vector<std::string> read_pc_filter(std::string filename) {
+  if (filename.empty()) return {};
+  PATHFINDER_CHECK(fs::is_regular_file(filename),
+                   "PathFinder Error: No such file `" + filename + "`");
+
+  std::vector<std::string> patterns;
+  for (auto line : split_all(read_from_file(filename), '\n')) {
+    line = strip(line);
+    if (!line.empty() && line[0] != '#') patterns.push_back(line);
+  }
+  return patterns;
+}
+
+void apply_pc_filter() {
+  if (PC_ALLOWLIST.empty() && PC_DENYLIST.empty()) return;
+
+  size_t num_filtered = TPC().FilterPCs(read_pc_filter(PC_ALLOWLIST),
+                                        read_pc_filter(PC_DENYLIST));
+  std::cout << "Filtered " << num_filtered << " of "
+            << TPC().GetNumInstrumented() << " instrumented PCs\n";
+}
+
 void add_cmd_line_constraint() {
   if (CMD_LINE_CONSTRAINT == "") return;
 
@@ -139,6 +163,13 @@ int driver(UserCallback Callback) {
 
   prepare_random_seed();
   if (CMD_LINE_INPUT.size() == 0) prepare_corpus();
+  if (FORK_SERVER) TPC().MapSharedMemory();
+  if (LOOP_MAX_PERIOD > 0)
+    TPC().SetLoopCompression(LOOP_MAX_PERIOD, LOOP_BUCKETS);
+  TPC().SetPatienceDiff(DIFF == DIFF_PATIENCE);
+  TPC().SetThreadPolicy(TRACE_THREAD_POLICY);
+  apply_pc_filter();
+  TPC().CollectCmpLiterals(CMP_LITERALS > 0);
 
   Engine engine(Callback, params_size(), start_time, MAX_TOTAL_TIME,
                 MAX_TOTAL_GEN, &TPC());
@@ -155,7 +186,11 @@ int driver(UserCallback Callback) {
     engine.run_corpus_and_output_cov();
     exit(0);
   }
-  int num_starting_intput = engine.run_corpus();
+  // The path tree of a snapshot already holds the corpus, the conditions
+  // synthesized from it, and the nondeterministic PCs found by warming up.
+  bool resuming = !RESUME_FILENAME.empty() && !RUN_ONLY;
+  if (resuming) engine.resume(RESUME_FILENAME);
+  int num_starting_intput = resuming ? 0 : engine.run_corpus();
   if (RUN_ONLY) {
     std::cout << doubleline() << "Running corpus with "
               << std::to_string(num_starting_intput) << " inputs done in "
@@ -174,7 +209,7 @@ int driver(UserCallback Callback) {
   }
 
   engine.reset_counter();
-  engine.warmingup();
+  if (!resuming) engine.warmingup();
 
   int num_iter = 1;
   while (num_iter <= MAX_ITER) {
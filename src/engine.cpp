@@ -7,6 +7,8 @@
 #include <iomanip>
 #include <sstream>
 
+#include "snapshot.h"
+
 bool is_initial_seed;
 
 namespace pathfinder {
@@ -24,9 +26,13 @@ Engine::Engine(UserCallback callback_, size_t num_args_,
   assert(num_args > 0);
 
   exectree = std::make_unique<ExecTree>(tpc);
+  scheduler = std::make_unique<Scheduler>(exectree.get());
   input_generator = std::make_unique<InputGenerator>();
 
+  if (FORK_SERVER) fork_server = std::make_unique<ForkServer>(callback, tpc);
+
   next_time_to_output_stat = output_stat_interval;
+  next_time_to_snapshot = SNAPSHOT_INTERVAL;
 }
 void Engine::exit_if_time_up() {
   size_t elapsed = elapsed_from_s(started_at);
@@ -38,6 +44,12 @@ void Engine::exit_if_time_up() {
     }
   }
 
+  if (SNAPSHOT_FILENAME != "" && elapsed >= next_time_to_snapshot) {
+    save_snapshot();
+    while (next_time_to_snapshot <= elapsed)
+      next_time_to_snapshot += SNAPSHOT_INTERVAL;
+  }
+
   bool time_up =
       elapsed > total_time_budget || total_gen_cnt > max_generation_cnt;
   if (!time_up) return;
@@ -50,15 +62,20 @@ void Engine::exit_if_time_up() {
   } else {
     std::cout << to_string();
   }
+  if (SNAPSHOT_FILENAME != "") save_snapshot();
 
   exit(0);
 }
+void Engine::save_snapshot() {
+  PATHFINDER_TIMER(time_dump,
+                   Snapshot::save(SNAPSHOT_FILENAME, *exectree, tpc));
+  log_msg(VERBOSE_MID, "\nSaved snapshot to `" + SNAPSHOT_FILENAME + "`\n")
+}
 InputGenerator* Engine::ig() { return input_generator.get(); }
 LeafNode* Engine::schedule() {
   assert(!exectree->is_empty());
 
-  assert(SCHEDULING_STRATEGY == SCHEDULE_RAND);
-  return random_choice(exectree->get_leaves());
+  return scheduler->schedule();
 }
 std::unique_ptr<FunSynthesized> Engine::trivial_enum() {
   return std::make_unique<FunSynthesized>(
@@ -70,11 +87,13 @@ std::unique_ptr<FunSynthesized> Engine::trivial_numeric() {
       "trivial", get_numeric_param_names(),
       std::make_unique<BoolExpr>(BoolExpr::true_expr()));
 }
-std::pair<int, ExecPath> Engine::run_callback(
+std::pair<int, ExecPathView> Engine::run_callback(
     const Input& input, bool measure_covered_pc_before_running,
     bool is_initial_seed_) {
+  // The returned path is a view of the path log of `tpc`,
+  // which is valid until the next execution.
   int run_status;
-  ExecPath epath;
+  ExecPathView epath;
 
   is_initial_seed = is_initial_seed_;
 
@@ -85,7 +104,9 @@ std::pair<int, ExecPath> Engine::run_callback(
     if (measure_covered_pc_before_running) covered_pc = tpc->GetNumCovered();
   }
 
-  run_status = callback(input);
+  run_status = fork_server != nullptr
+                   ? fork_server->run(input, CALLBACK_TIMEOUT)
+                   : callback(input);
   if (tpc != nullptr) tpc->TraceOff();
   if (run_status == PATHFINDER_UNEXPECTED_EXCEPTION) {
     if (IGNORE_EXCEPTION) {
@@ -96,13 +117,29 @@ std::pair<int, ExecPath> Engine::run_callback(
       abort();
     }
   }
-  if (tpc != nullptr) epath = tpc->GetPathLog();
+  if (tpc != nullptr) epath = tpc->GetPathLogView();
+  if (tpc != nullptr && CMP_LITERALS > 0)
+    count_literals(tpc->GetCmpLiterals());
 
   return std::make_pair(run_status, epath);
 }
 void Engine::check_run_result(int run_status) {
   assert(tpc != nullptr);
 
+  if (run_status == PATHFINDER_CRASH) {
+    num_crash++;
+    mark_last_seed_as_crash();
+    log_msg(VERBOSE_LOW,
+            "\nCallback crashed. Input kept as `" + last_written_seed + "`\n");
+    return;
+  } else if (run_status == PATHFINDER_TIMEOUT) {
+    num_timeout++;
+    mark_last_seed_as_timeout();
+    log_msg(VERBOSE_LOW, "\nCallback timed out. Input kept as `" +
+                             last_written_seed + "`\n");
+    return;
+  }
+
   if (run_status == PATHFINDER_PASS) {
     delete_last_seed();
     return;
@@ -112,10 +149,12 @@ void Engine::check_run_result(int run_status) {
     num_fail++;
   }
 
-  size_t covered_pc_new = tpc->GetNumCovered();
-  if (covered_pc_new > covered_pc) {
-    covered_pc = covered_pc_new;
+  ExecPathView new_covered = tpc->GetNewCovered();
+  covered_pc = tpc->GetNumCovered();
+  if (!new_covered.empty()) {
     commit_last_seed();
+    log_msg(VERBOSE_HIGH, "\nNew PCs covered by `" + last_written_seed +
+                              "`: " + epath_to_string(new_covered.to_vec()));
   } else {
     delete_last_seed();
   }
@@ -124,6 +163,30 @@ void Engine::set_generator(std::vector<EnumCondition*> enum_conditions,
                            std::vector<NumericCondition*> numeric_conditions) {
   ig()->set_condition(enum_conditions, numeric_conditions);
 }
+std::vector<Flip> Engine::get_flips(Node* target) {
+  // One query per node below the root that has a sibling to leave it for.
+  // Enum conditions cannot be negated, so a sibling is aimed at instead.
+  std::vector<Flip> flips;
+  bool has_query = false;
+  for (auto& node : target->get_path_nodes()) {
+    if (node->is_root()) continue;
+
+    Flip flip{node->cond.get()};
+    std::vector<Node*> siblings;
+    for (auto& sibling : node->get_siblings(false))
+      if (!sibling->cond->invalid()) siblings.push_back(sibling);
+    CondType condtype = node->cond->get_condtype();
+    if (condtype == CT_NUMERIC && !node->cond->invalid())
+      flip.negate = !siblings.empty();
+    else if (condtype == CT_ENUM && !siblings.empty())
+      flip.sibling = random_choice(siblings)->cond.get();
+
+    has_query |= flip.is_query();
+    flips.push_back(flip);
+  }
+  if (!has_query) flips.clear();
+  return flips;
+}
 std::optional<Input> Engine::run_generator() {
   std::optional<Input> input = ig()->gen();
   if (input.has_value()) write_to_output_corpus(input.value());
@@ -154,10 +217,10 @@ void Engine::refine(const std::set<Node*>& refinement_target) {
       if (synthesis_status == SUCCESS || synthesis_status == FAIL) {
         if (synthesis_status == SUCCESS) {
           assert(cond_new != nullptr);
-          target->cond = std::move(cond_new);
+          target->set_cond(std::move(cond_new));
           if (is_pair) {
             assert(cond_new_sibling != nullptr);
-            sibling.value()->cond = std::move(cond_new_sibling);
+            sibling.value()->set_cond(std::move(cond_new_sibling));
           }
         }
 
@@ -220,6 +283,7 @@ int Engine::run_corpus() {
   log_msg(VERBOSE_LOW,
           "In corpus, " + std::to_string(seeds.size()) + " inputs to run.\n");
   int num_runned_input = 0;
+  std::vector<PathEntry> entries;
   for (auto seed : seeds) {
     auto raw_input = uint8_vec_to_long_vec(file_to_vector(seed));
     auto input_opt = deserialize(raw_input);
@@ -235,16 +299,14 @@ int Engine::run_corpus() {
     log_msg(VERBOSE_MID, indent(1) + "running input `" + seed.string() + "` " +
                              vec_to_string(raw_input) + " ...\n");
     int run_status;
-    ExecPath epath;
+    ExecPathView epath;
     std::tie(run_status, epath) = run_callback(input, false, !RUN_ONLY);
-    assert(RUN_ONLY);
-    if (!RUN_ONLY) {
-      // TODO: Remove it?
-      if (epath.size() > 0 && exectree != nullptr)
-        exectree->insert(epath, input, run_status);
-    }
+    if (!RUN_ONLY && epath.size() > 0)
+      entries.push_back({epath.to_vec(), {input}, run_status});
     num_runned_input++;
   }
+  // Built at once, rather than by splitting nodes seed after seed.
+  if (!entries.empty()) exectree->bulk_insert(std::move(entries));
   std::cout << std::endl;
   return num_runned_input;
 }
@@ -319,7 +381,7 @@ void Engine::run_corpus_and_output_cov() {
       log_msg(VERBOSE_MID, indent(1) + "running input `" + seed.string() +
                                "` " + vec_to_string(raw_input) + " ...\n");
       int run_status;
-      ExecPath epath;
+      ExecPathView epath;
       std::tie(run_status, epath) = run_callback(input, false, !RUN_ONLY);
     }
     append_to_file(
@@ -328,6 +390,13 @@ void Engine::run_corpus_and_output_cov() {
     t += COV_INTERVAL;
   }
 }
+void Engine::resume(const std::string& filename) {
+  Snapshot::load(filename, *exectree, tpc);
+  log_msg(VERBOSE_LOW,
+          "Resumed from snapshot `" + filename + "` with " +
+              std::to_string(exectree->leaves.size()) + " paths and " +
+              std::to_string(tpc->GetNumCovered()) + " covered PCs\n");
+}
 int Engine::run_one_input() {
   auto raw_input = uint8_vec_to_long_vec(file_to_vector(CORPUS));
   auto input_opt = deserialize(raw_input);
@@ -339,14 +408,9 @@ int Engine::run_one_input() {
   log_msg(VERBOSE_MID, indent(1) + "running input `" + CORPUS.string() + "` " +
                            input_to_string(input) + " ...\n");
   int run_status;
-  ExecPath epath;
+  ExecPathView epath;
   std::tie(run_status, epath) = run_callback(input, false, !RUN_ONLY);
-  assert(RUN_ONLY);
-  if (!RUN_ONLY) {
-    // TODO: Remove it?
-    if (epath.size() > 0 && exectree != nullptr)
-      exectree->insert(epath, input, run_status);
-  }
+  if (!RUN_ONLY && epath.size() > 0) exectree->insert(epath, input, run_status);
 
   return 1;
 }
@@ -380,8 +444,9 @@ void Engine::warmingup(size_t cnt) {
 
       Input input;
   int run_status;
+  ExecPathView epath_view;
   ExecPath epath;
-  bool epath_truncated;
+  bool epath_truncated = false;
   for (size_t i = 0; i < cnt; i++) {
     // Run callback with random input CNT times.
     // We expect it can mitigate confusion of execution path from initialization
@@ -391,18 +456,20 @@ void Engine::warmingup(size_t cnt) {
       auto input_opt = run_generator();
       assert(input_opt.has_value());
       input = input_opt.value();
-      std::tie(run_status, epath) = run_callback(input, true, false);
+      std::tie(run_status, epath_view) = run_callback(input, true, false);
       check_run_result(run_status);
-      epath_truncated = tpc->truncated(epath);
+      epath_truncated = tpc->truncated(epath_view);
 
-      if (run_status != PATHFINDER_PASS) break;
+      if (run_status == 0 || run_status == PATHFINDER_EXPECTED_EXCEPTION)
+        break;
     }
     total_gen_cnt++;
     PATHFINDER_CHECK(
-        epath.size() != 0,
+        epath_view.size() != 0,
         "Exited before `PathFinderExecuteTarget`.\n"
         "Make sure your fuzz driver does not terminate before it.");
   }
+  epath = epath_view.to_vec();
 
   if (WO_NBP) {
     log_msg(VERBOSE_MID, "\n" + singleline()) time_warming_up +=
@@ -410,32 +477,63 @@ void Engine::warmingup(size_t cnt) {
     return;
   }
 
-  // Check if execution paths of one input conflicts
-  for (size_t i = 0; i < cnt; i++) {
-    ExecPath epath_from_same_input = run_callback(input, false, false).second;
-
-    if (tpc->eq_significant(epath, epath_from_same_input) ||
-        tpc->considerably_longer(epath_from_same_input, epath)) {
-      continue;
-    } else if (tpc->considerably_longer(epath, epath_from_same_input)) {
-      exectree->purge_and_reinsert(epath, epath_from_same_input);
-      continue;
-    }
+  // Run the same input ND_VOTE_RUNS times. PCs that do not show up in
+  // every run are nondeterministic, and are found at once by voting. What is
+  // still different is left to CheckDiff against the first run.
+  std::vector<ExecPath> differing;
+  tpc->ClearVotes();
+  if (!epath_truncated) tpc->Vote(epath);
+  for (size_t i = 0; i < ND_VOTE_RUNS; i++) {
+    ExecPathView epath_from_same_input =
+        run_callback(input, false, false).second;
+
+    if (!tpc->truncated(epath_from_same_input))
+      tpc->Vote(epath_from_same_input);
+    if (!tpc->eq_significant(epath, epath_from_same_input))
+      differing.push_back(epath_from_same_input.to_vec());
+  }
+  size_t num_voted_nd = tpc->AddNDByVotes();
+  if (num_voted_nd != 0)
+    log_msg(VERBOSE_MID, "\nFound " + std::to_string(num_voted_nd) +
+                             " nondeterministic PCs by voting");
+
+  if (!epath_truncated) epath = tpc->Prune(epath);
+  // A conflict that adds nondeterministic PCs has all runs checked again, as
+  // they compare differently once pruned anew.
+  bool found_conflict = true;
+  while (found_conflict) {
+    found_conflict = false;
+    for (auto& epath_differing : differing) {
+      ExecPath epath_from_same_input = tpc->Prune(epath_differing);
+      if (tpc->eq_significant(epath, epath_from_same_input) ||
+          tpc->considerably_longer(epath_from_same_input, epath)) {
+        continue;
+      } else if (tpc->considerably_longer(epath, epath_from_same_input)) {
+        exectree->purge_and_reinsert(epath, epath_from_same_input);
+        continue;
+      }
 
-    // Conflict
-    log_msg(VERBOSE_MID,
-            "\nFound different execution path from same input(length: " +
-                std::to_string(epath.size()) + ", " +
-                std::to_string(epath_from_same_input.size()) +
-                "). Check nondeterministic PCs");
-    tpc->CheckDiff(epath, epath_from_same_input);
-    if (!epath_truncated) {
-      epath = tpc->Prune(std::move(epath));
-    } else {
-      epath = run_callback(input, false, false).second;
-      epath_truncated = tpc->truncated(epath);
+      // Conflict
+      log_msg(VERBOSE_MID,
+              "\nFound different execution path from same input(length: " +
+                  std::to_string(epath.size()) + ", " +
+                  std::to_string(epath_from_same_input.size()) +
+                  "). Check nondeterministic PCs");
+      size_t num_nd = tpc->GetNumND();
+      tpc->CheckDiff(epath, epath_from_same_input);
+      // A truncated path is run again rather than pruned, as what it misses
+      // is not known.
+      if (!epath_truncated) {
+        epath = tpc->Prune(epath);
+      } else {
+        epath = run_callback(input, false, false).second.to_vec();
+        epath_truncated = tpc->truncated(epath);
+      }
+      if (tpc->GetNumND() > num_nd) {
+        found_conflict = true;
+        break;
+      }
     }
-    i = 0;
   }
   log_msg(VERBOSE_MID, "\n" + singleline()) time_warming_up +=
       elapsed_from_ns(warming_up_start);
@@ -447,12 +545,15 @@ void Engine::run() {
   PATHFINDER_TIMER(
       time_scheduling, std::vector<EnumCondition*> enum_conditions;
       std::vector<NumericCondition*> numeric_conditions;
-      if (!exectree->is_empty()) {
+      std::vector<Flip> flips; if (!exectree->is_empty()) {
         Node* target = schedule();
         std::tie(enum_conditions, numeric_conditions) = target->get_path_cond();
+        if (SEARCH_STRATEGY == SEARCH_GENERATIONAL) flips = get_flips(target);
       });
-  PATHFINDER_TIMER(time_generation_setting,
-                   set_generator(enum_conditions, numeric_conditions));
+  PATHFINDER_TIMER(
+      time_generation_setting,
+      if (flips.empty()) set_generator(enum_conditions, numeric_conditions);
+      else ig()->set_flips(std::move(flips)););
   gen_remained = MAX_GEN_PER_ITER;
   size_t gen_time = 0;
   std::chrono::steady_clock::time_point before_iter =
@@ -461,14 +562,20 @@ void Engine::run() {
     exit_if_time_up();
     Input input;
     int run_status;
-    ExecPath epath;
+    ExecPathView epath;
+    size_t latency;
     while (true) {
       PATHFINDER_TIMER(time_generation_gen, auto input_opt = run_generator(););
-      if (!input_opt.has_value()) return;
+      if (!input_opt.has_value()) {
+        if (ig()->is_unsat()) scheduler->report_failure();
+        return;
+      }
       input = input_opt.value();
-      PATHFINDER_TIMER(
-          time_running_callback,
-          std::tie(run_status, epath) = run_callback(input, true, false););
+      std::chrono::steady_clock::time_point before_run =
+          std::chrono::steady_clock::now();
+      std::tie(run_status, epath) = run_callback(input, true, false);
+      latency = elapsed_from_ns(before_run);
+      time_running_callback += latency;
       PATHFINDER_TIMER(time_result_check, check_run_result(run_status));
 
       if (run_status == 0 || run_status == PATHFINDER_EXPECTED_EXCEPTION) break;
@@ -509,7 +616,7 @@ void Engine::run() {
         Node* lca = leaf_old->lowest_common_ancestor(leaf_new);
         assert(lca->is_internal());
         for (auto& child : as_internal(lca)->children)
-          child->cond = std::make_unique<NeglectCondition>();
+          child->set_cond(std::make_unique<NeglectCondition>());
         return;
       }
 
@@ -538,11 +645,21 @@ void Engine::run() {
     }
     bool found_new_path = false;
     PATHFINDER_TIMER(time_path_check_duplicate,
-                     bool is_existing_epath = exectree->has(epath););
-    if (!is_existing_epath) {
+                     LeafNode* existing_leaf =
+                         exectree->is_empty()
+                             ? nullptr
+                             : exectree->find_leaf(epath, tpc->GetPathHash());
+                     bool is_existing_epath = existing_leaf != nullptr;);
+    if (is_existing_epath) {
+      scheduler->report_hit(existing_leaf);
+      scheduler->report_run(existing_leaf, latency, epath.size());
+    } else {
       found_new_path = true;
+      scheduler->report_new_path();
       PATHFINDER_TIMER(time_path_check_insert,
-                       exectree->insert(epath, input, run_status));
+                       Node* new_leaf =
+                           exectree->insert(epath, input, run_status));
+      scheduler->report_run(as_leaf(new_leaf), latency, epath.size());
       assert(exectree->is_sorted());
     }
 
@@ -551,8 +668,10 @@ void Engine::run() {
         std::set<Node*> incorrect_nodes =
             exectree->evaluate_conditions(input, epath);
         bool found_counter_example = !incorrect_nodes.empty();
+        if (found_counter_example) scheduler->report_counterexample();
         if (!found_new_path && found_counter_example) {
-          exectree->insert(epath, input, run_status);
+          // Kept over the reservoir sample, as synthesis has to see it.
+          exectree->insert(epath, input, run_status, true);
           assert(exectree->is_sorted());
         } std::set<Node*>
             refinement_target;
@@ -606,6 +725,10 @@ std::string Engine::stats() const {
   if (num_nd_pc != 0)
     str +=
         "Number of nondeterministic PCs: " + std::to_string(num_nd_pc) + "\n";
+  if (num_crash != 0)
+    str += "Number of crashes: " + std::to_string(num_crash) + "\n";
+  if (num_timeout != 0)
+    str += "Number of timeouts: " + std::to_string(num_timeout) + "\n";
 
   std::string str_time_detailed;
   str_time_detailed +=
@@ -750,9 +873,15 @@ void Engine::output_stat(const std::string& filename, size_t time) const {
   str +=
       "    Number of arguments" + comma + std::to_string(params_size()) + "\n";
   str += "    Total number of input in ACT" + comma +
-         std::to_string(exectree->num_total_input()) + "\n\n";
+         std::to_string(exectree->num_total_input()) + "\n";
+  str += "Resident size of ACT(bytes)" + comma +
+         std::to_string(exectree->resident_size()) + "\n";
+  str += "Spilled size of ACT(bytes)" + comma +
+         std::to_string(exectree->spilled_size()) + "\n\n";
   str += "Number of passed inputs" + comma + std::to_string(num_pass) + "\n";
-  str += "Number of failed inputs" + comma + std::to_string(num_fail) + "\n\n";
+  str += "Number of failed inputs" + comma + std::to_string(num_fail) + "\n";
+  str += "Number of crashes" + comma + std::to_string(num_crash) + "\n";
+  str += "Number of timeouts" + comma + std::to_string(num_timeout) + "\n\n";
   str += "Time for warming up(ms)" + comma +
          std::to_string(ns_to_ms(time_warming_up)) + "\n";
   str += "Time for conflict check(ms)" + comma +
@@ -831,6 +960,10 @@ const std::string& Engine::potential_crash_prefix() {
   static const std::string prefix = "CRASH_";
   return prefix;
 }
+const std::string& Engine::timeout_prefix() {
+  static const std::string prefix = "TIMEOUT_";
+  return prefix;
+}
 fs::path Engine::output_file_path(const std::string& file_name) {
   return CORPUS / file_name;
 }
@@ -869,6 +1002,26 @@ void Engine::commit_last_seed() {
 void Engine::delete_last_seed() {
   fs::remove(output_file_path(last_written_seed));
 }
+// Kept seeds are numbered, as inputs generated again after a crash or a
+// timeout share its time and gen count.
+void Engine::mark_last_seed_as_crash() {
+  assert(is_prefix_of(potential_crash_prefix(), last_written_seed));
+  std::string old_seed_name = last_written_seed;
+  std::string new_seed_name =
+      last_written_seed + "_" + std::to_string(num_crash);
+  fs::rename(output_file_path(old_seed_name), output_file_path(new_seed_name));
+  last_written_seed = new_seed_name;
+}
+void Engine::mark_last_seed_as_timeout() {
+  assert(is_prefix_of(potential_crash_prefix(), last_written_seed));
+  std::string old_seed_name = last_written_seed;
+  std::string new_seed_name =
+      timeout_prefix() +
+      last_written_seed.substr(potential_crash_prefix().size()) + "_" +
+      std::to_string(num_timeout);
+  fs::rename(output_file_path(old_seed_name), output_file_path(new_seed_name));
+  last_written_seed = new_seed_name;
+}
 
 size_t Engine::time_conflict_check() const {
   return time_conflict_check_internal + time_conflict_check_reconstruction +
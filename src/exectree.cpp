@@ -11,36 +11,103 @@ namespace pathfinder {
 const PCID Node::EpsilonPCID = 0;
 const ExecPath Node::EPSILON = ExecPath({Node::EpsilonPCID});
 
-Node::Node(ExecTree* exectree_) : exectree(exectree_) {}
+Node::Node(ExecTree* exectree_) : exectree(exectree_) {
+  id = exectree->node_of_id.size();
+  exectree->node_of_id.push_back(nullptr);
+}
 const size_t Node::MAX_INPUT_PER_PATH;
 ExecPath Node::get_path_log(bool squeeze) {
-  ExecPath prefix_ = squeeze && prefix == EPSILON ? ExecPath() : prefix;
+  ExecPathView prefix = get_prefix();
+  ExecPath prefix_ =
+      squeeze && prefix == EPSILON ? ExecPath() : prefix.to_vec();
 
   if (is_root()) return prefix_;
   return vec_concat(parent->get_path_log(squeeze), std::move(prefix_));
 }
 bool Node::is_root() const { return parent == nullptr; }
-const ExecPath& Node::get_prefix() const { return prefix; }
-const EnumArgBitVecArray& Node::get_enum_bvs() const { return enum_bvs; }
+ExecPathView Node::get_prefix() const {
+  return ExecPathView(exectree->prefix_pool.data() + prefix.offset,
+                      prefix.length);
+}
+uint32_t Node::get_id() const { return id; }
+const EnumArgBitVecArray& Node::get_enum_bvs() const {
+  refresh_aggregates();
+  return enum_bvs;
+}
+size_t Node::get_height() const {
+  refresh_aggregates();
+  return height;
+}
+size_t Node::get_num_leaves() const {
+  refresh_aggregates();
+  return num_leaves;
+}
+size_t Node::get_num_inputs() const {
+  refresh_aggregates();
+  return num_inputs;
+}
 std::pair<std::vector<EnumCondition*>, std::vector<NumericCondition*>>
 Node::get_path_cond() {
-  ExecPath epath = get_path_log();
-  std::vector<Node*> nodes = exectree->get_nodes(epath);
+  if (path_conds_valid)
+    return std::make_pair(path_enum_conds, path_numeric_conds);
 
-  std::vector<EnumCondition*> enum_conditions;
-  std::vector<NumericCondition*> numeric_conditions;
+  std::vector<Node*> nodes = get_path_nodes();
+  if (is_internal())
+    if (Node* epsilon_child = as_internal(this)->lookup_child(EPSILON))
+      nodes.push_back(epsilon_child);
+
+  path_enum_conds.clear();
+  path_numeric_conds.clear();
   for (auto& node : nodes) {
-    if (EnumCondition* enum_condition =
-            dynamic_cast<EnumCondition*>(node->cond.get()))
-      enum_conditions.push_back(enum_condition);
-    else if (NumericCondition* numeric_condition =
-                 dynamic_cast<NumericCondition*>(node->cond.get()))
-      numeric_conditions.push_back(numeric_condition);
+    CondType condtype = node->cond->get_condtype();
+    if (condtype == CT_ENUM)
+      path_enum_conds.push_back(static_cast<EnumCondition*>(node->cond.get()));
+    else if (condtype == CT_NUMERIC)
+      path_numeric_conds.push_back(
+          static_cast<NumericCondition*>(node->cond.get()));
   }
+  path_conds_valid = true;
 
-  return std::make_pair(enum_conditions, numeric_conditions);
+  return std::make_pair(path_enum_conds, path_numeric_conds);
+}
+const std::vector<Node*>& Node::get_path_nodes() {
+  if (!path_nodes_valid) {
+    if (is_root()) {
+      path_nodes = {this};
+    } else {
+      path_nodes = parent->get_path_nodes();
+      path_nodes.push_back(this);
+    }
+    path_nodes_valid = true;
+  }
+  return path_nodes;
+}
+void Node::invalidate_path_cache() {
+  if (!path_nodes_valid) return;
+
+  path_nodes_valid = false;
+  path_nodes.clear();
+  path_conds_valid = false;
+  if (is_internal())
+    for (auto& child : as_internal(this)->children)
+      child->invalidate_path_cache();
+}
+size_t Node::get_depth() const {
+  size_t depth = 0;
+  for (Node* node = parent; node != nullptr; node = node->parent) depth++;
+  return depth;
+}
+void Node::set_prefix(ExecPathView prefix_) {
+  // It may become, or stop being, an epsilon child.
+  if (!is_root()) parent->path_conds_valid = false;
+  prefix = exectree->intern_prefix(prefix_);
+  exectree->index_pcids(this, get_prefix());
+}
+void Node::drop_prefix(size_t len) {
+  assert(len < prefix.length);
+  prefix.offset += len;
+  prefix.length -= len;
 }
-size_t Node::get_depth() const { return depth; }
 std::pair<std::set<Input>, std::set<Input>> Node::get_examples() {
   std::set<Input> pos_examples, neg_examples;
   pos_examples = get_inputset();
@@ -79,7 +146,8 @@ std::vector<Node*> Node::get_siblings(bool include_self) const {
 }
 EnumArgBitVecArray Node::get_sibling_enum_bvs() const {
   EnumArgBitVecArray sibling_enum_bvs = initial_enum_bvs(false);
-  for (auto node : get_siblings(false)) sibling_enum_bvs.bit_or(node->enum_bvs);
+  for (auto node : get_siblings(false))
+    sibling_enum_bvs.bit_or(node->get_enum_bvs());
   return sibling_enum_bvs;
 }
 std::set<Node*> Node::evaluate_condition(Input input) {
@@ -100,19 +168,26 @@ std::set<Node*> Node::evaluate_condition(Input input) {
   }
   return incorrect_nodes;
 }
+void Node::set_cond(std::unique_ptr<BranchCondition> cond_) {
+  cond = std::move(cond_);
+  // Only paths through this node have its condition, and so does its parent's
+  // if it is an epsilon child.
+  invalidate_path_cache();
+  if (!is_root()) parent->path_conds_valid = false;
+}
 void Node::promote_cond() {
   assert(cond != nullptr);
   CondType condtype = cond->get_condtype();
   if (condtype == CT_ENUM) {
-    cond = std::make_unique<NumericCondition>();
+    set_cond(std::make_unique<NumericCondition>());
   } else if (condtype == CT_NUMERIC) {
-    cond = std::make_unique<NeglectCondition>();
+    set_cond(std::make_unique<NeglectCondition>());
   }
 
   if (auto sibling = get_sibling()) {
     assert(sibling.value()->cond != nullptr);
     assert(sibling.value()->cond->get_condtype() == condtype);
-    sibling.value()->cond = copy(cond);
+    sibling.value()->set_cond(copy(cond));
   }
 }
 Node* Node::lowest_common_ancestor(Node* other) {
@@ -122,8 +197,10 @@ Node* Node::lowest_common_ancestor(Node* other) {
   Node* ancestor2 = other;
 
   // lift a lower node to be same with higher node.
-  while (ancestor1->depth > ancestor2->depth) ancestor1 = ancestor1->parent;
-  while (ancestor1->depth < ancestor2->depth) ancestor2 = ancestor2->parent;
+  size_t depth1 = ancestor1->get_depth();
+  size_t depth2 = ancestor2->get_depth();
+  for (; depth1 > depth2; depth1--) ancestor1 = ancestor1->parent;
+  for (; depth1 < depth2; depth2--) ancestor2 = ancestor2->parent;
 
   while (ancestor1 != ancestor2) {
     ancestor1 = ancestor1->parent;
@@ -134,14 +211,15 @@ Node* Node::lowest_common_ancestor(Node* other) {
 }
 std::string Node::to_string(bool print_prefix) const {
   std::string str;
+  size_t depth = get_depth();
   if (print_prefix)
     add_str(VERBOSE_LOW, str,
-            indent(depth) + "prefix: " + epath_to_string(prefix) + "\n");
+            indent(depth) + "prefix: " + epath_to_string(get_prefix().to_vec()) + "\n");
 
   add_str(VERBOSE_HIGH, str,
           indent(depth) + "depth: " + std::to_string(depth) + "\n");
 
-  std::vector<std::string> bv_str_all = enum_bvs.to_string();
+  std::vector<std::string> bv_str_all = get_enum_bvs().to_string();
   std::string enum_str;
   for (size_t i = 0; i < bv_str_all.size(); i++) {
     std::string prefix =
@@ -161,61 +239,102 @@ std::string Node::to_string(bool print_prefix) const {
   return str;
 }
 
-LeafNode::LeafNode(ExecTree* exectree_) : Node(exectree_) {}
+LeafNode::LeafNode(ExecTree* exectree_) : Node(exectree_) { num_leaves = 1; }
 bool LeafNode::struct_eq(const Node& other) const {
   if (!other.is_leaf()) return false;
 
-  return prefix == other.prefix;
+  return get_prefix() == other.get_prefix();
 }
-void LeafNode::insert_inputset(ExecPath epath_tail, std::set<Input> inputset_,
-                               int run_status) {
-  if (is_full()) {
-    Input evicted = evict_random();
-    exectree->all_input.erase(evicted);
-  }
-
-  for (auto& input : inputset_) {
-    inputset.insert(input);
-    exectree->all_input[input] = this;
-  }
-  update_enum_bvs();
+void LeafNode::insert_inputset(ExecPathView epath_tail,
+                               std::set<Input> inputset_, int run_status,
+                               bool must_keep) {
+  exectree->page_in(this);
+  for (auto& input : inputset_) add_input(input, must_keep);
+  update_aggregates();
 
   if (run_status == 0)
     exception_path = false;
   else if (run_status == PATHFINDER_EXPECTED_EXCEPTION)
     exception_path = true;
   if (!is_root()) parent->mark_exception();
-  tail = epath_tail;
-}
-void LeafNode::merge_inputset(std::set<Input> other) {
+  tail = epath_tail.to_vec();
+  exectree->index_pcids(this, tail);
+  exectree->account(this);
+}
+void LeafNode::merge_inputset(std::vector<Input> other,
+                              size_t other_num_seen) {
+  assert(!is_spilled());
+  size_t own_num_seen = std::max(num_seen, inputset.size());
+  other_num_seen = std::max(other_num_seen, other.size());
+  num_seen = own_num_seen + other_num_seen;
   if (inputset.size() + other.size() <= MAX_INPUT_PER_PATH) {
     for (auto&& input : other) {
-      exectree->all_input[input] = this;
+      if (has_input(input)) continue;
+      put_input(input);
+      exectree->index_input(input, this);
     }
-    inputset.insert(other.begin(), other.end());
-  } else {
-    size_t num_left = MAX_INPUT_PER_PATH - inputset.size();
-    for (auto& input : other) {
-      if (num_left == 0) {
-        exectree->all_input.erase(input);
-      } else {
-        exectree->all_input[input] = this;
-        inputset.insert(input);
-        num_left--;
-      }
+    update_aggregates();
+    exectree->account(this);
+    return;
+  }
+
+  // Weighted sampling without replacement, where an input of either sample
+  // stands for `num_seen / size` inputs seen.
+  std::vector<std::pair<double, Input>> keyed;
+  auto add_keyed = [&keyed](const std::vector<Input>& inputs, size_t seen) {
+    double weight = (double)seen / inputs.size();
+    for (auto& input : inputs) {
+      double u = (std::rand() + 1.0) / (RAND_MAX + 2.0);
+      keyed.push_back({std::pow(u, 1 / weight), input});
     }
+  };
+  other.erase(std::remove_if(other.begin(), other.end(),
+                             [this](auto& input) { return has_input(input); }),
+              other.end());
+  if (!inputset.empty()) add_keyed(inputset, own_num_seen);
+  if (!other.empty()) add_keyed(other, other_num_seen);
+  size_t num_kept = std::min(keyed.size(), MAX_INPUT_PER_PATH);
+  std::nth_element(
+      keyed.begin(), keyed.begin() + num_kept, keyed.end(),
+      [](auto& left, auto& right) { return left.first > right.first; });
+
+  inputset.clear();
+  for (size_t i = 0; i < num_kept; i++) {
+    inputset.push_back(keyed[i].second);
+    exectree->index_input(keyed[i].second, this);
   }
-  update_enum_bvs();
+  std::sort(inputset.begin(), inputset.end());
+  for (size_t i = num_kept; i < keyed.size(); i++)
+    exectree->all_input.erase(keyed[i].second.get_id());
+  update_aggregates();
+  exectree->account(this);
 }
 bool LeafNode::is_full() const { return inputset.size() >= MAX_INPUT_PER_PATH; }
+bool LeafNode::is_spilled() const { return spilled; }
+ExecPathView LeafNode::get_tail() const {
+  return is_spilled() ? exectree->spilled_tail(this) : ExecPathView(tail);
+}
+void LeafNode::record_run(size_t latency, size_t path_length) {
+  static const double ALPHA = 0.2;
+  if (num_runs == 0) {
+    latency_ema = latency;
+    path_length_ema = path_length;
+  } else {
+    latency_ema += ALPHA * (latency - latency_ema);
+    path_length_ema += ALPHA * (path_length - path_length_ema);
+  }
+  num_runs++;
+}
+double LeafNode::get_latency() const { return latency_ema; }
+size_t LeafNode::get_num_runs() const { return num_runs; }
 
-std::pair<Node*, ExecPath> LeafNode::find(ExecPath epath) {
+std::pair<Node*, ExecPathView> LeafNode::find(ExecPathView epath) {
   assert(epath.size() > 0);
-  if (epath == prefix) return std::make_pair(this, ExecPath());
+  ExecPathView prefix = get_prefix();
+  if (epath == prefix) return std::make_pair(this, ExecPathView());
   size_t common_len = common_prefix_length(prefix, epath);
-  ExecPath common = subvec(prefix, 0, common_len);
-  ExecPath epath_rem = subvec(epath, common_len);
-  if (common != prefix) {
+  ExecPathView epath_rem = epath.subview(common_len);
+  if (common_len != prefix.size()) {
     if (is_root()) {
       return std::make_pair(nullptr, epath);
     } else {
@@ -227,29 +346,23 @@ std::pair<Node*, ExecPath> LeafNode::find(ExecPath epath) {
 }
 bool LeafNode::is_internal() const { return false; }
 bool LeafNode::is_leaf() const { return true; }
-void LeafNode::update_enum_bvs() {
-  if (default_condtype() != CT_ENUM) return;
-
-  EnumArgBitVecArray enum_bvs_old = EnumArgBitVecArray(enum_bvs);
-  EnumArgBitVecArray enum_bvs_new = initial_enum_bvs(false);
-  for (auto&& input : inputset) enum_bvs_new.set(input.get_enum_args());
-  if (enum_bvs_new != enum_bvs_old) {
-    enum_bvs = std::move(enum_bvs_new);
-    if (!is_root()) parent->update_enum_bvs();
+void LeafNode::refresh_aggregates() const {}
+void LeafNode::update_aggregates() {
+  // Inputs do not change while spilled.
+  if (is_spilled()) return;
+
+  if (default_condtype() == CT_ENUM) {
+    enum_bvs = initial_enum_bvs(false);
+    for (auto&& input : inputset) enum_bvs.set(input.get_enum_args());
   }
-}
-void LeafNode::update_depth() {
-  if (is_root()) {
-    depth = 0;
-  } else {
-    depth = parent->get_depth() + 1;
-  }
-
-  if (depth > exectree->height) exectree->height = depth;
+  num_inputs = inputset.size();
+  if (!is_root()) parent->invalidate_aggregates();
 }
 void LeafNode::filter_nd_pcid(TracePC* tpc, size_t prefix_len_so_far,
                               std::set<Node*>& filtered_nodes) {
   assert(tpc != nullptr);
+  exectree->page_in(this);
+  ExecPath prefix = get_prefix().to_vec();
   size_t prefix_before, prefix_after;
   if (prefix == Node::EPSILON) {
     prefix_before = 0;
@@ -282,12 +395,26 @@ void LeafNode::filter_nd_pcid(TracePC* tpc, size_t prefix_len_so_far,
   bool filtered =
       prefix_before != prefix_after || tail_before != tail_after || tail_moved;
 
-  if (filtered) filtered_nodes.insert(this);
+  if (filtered) {
+    set_prefix(prefix);
+    filtered_nodes.insert(this);
+    if (!is_root()) parent->children_dirty = true;
+  }
+  exectree->account(this);
 }
 std::string LeafNode::to_string(bool print_prefix) const {
   std::string str = Node::to_string(print_prefix);
+  size_t depth = get_depth();
 
-  if (inputset.size() > 0) {
+  if (num_runs > 0)
+    add_str(VERBOSE_HIGH, str,
+            indent(depth) + "cost: " +
+                std::to_string((size_t)latency_ema / 1000) + " us, " +
+                std::to_string((size_t)path_length_ema) + " PCs\n");
+
+  if (is_spilled()) {
+    add_str(VERBOSE_MID, str, indent(depth) + "input: (spilled)\n");
+  } else if (inputset.size() > 0) {
     std::string inputset_str;
     size_t PRINT_ARG_MAX = 5;
     size_t i = 0;
@@ -316,22 +443,53 @@ std::string LeafNode::to_string(bool print_prefix) const {
 
   return str;
 }
+bool LeafNode::has_input(const Input& input) const {
+  return std::binary_search(inputset.begin(), inputset.end(), input);
+}
+void LeafNode::put_input(const Input& input) {
+  inputset.insert(std::lower_bound(inputset.begin(), inputset.end(), input),
+                  input);
+}
+void LeafNode::add_input(const Input& input, bool must_keep) {
+  if (has_input(input)) return;
+
+  // Reservoir sampling, keeping the n-th input seen in place of a random one
+  // with probability MAX_INPUT_PER_PATH / n.
+  num_seen++;
+  if (is_full()) {
+    if (!must_keep && (size_t)std::rand() % num_seen >= MAX_INPUT_PER_PATH)
+      return;
+    Input evicted = evict_random();
+    exectree->all_input.erase(evicted.get_id());
+  }
+  put_input(input);
+  exectree->index_input(input, this);
+}
 Input LeafNode::evict_random() {
   assert(is_full());
-  size_t pos = (std::rand() % inputset.size());
-  auto it = inputset.begin();
-  std::advance(it, pos);
+  auto it = inputset.begin() + std::rand() % inputset.size();
   Input evicted = *it;
   inputset.erase(it);
   return evicted;
 }
-std::set<Input> LeafNode::get_inputset() { return inputset; }
+std::set<Input> LeafNode::get_inputset() {
+  exectree->page_in(this);
+  return std::set<Input>(inputset.begin(), inputset.end());
+}
+size_t LeafNode::estimate_bytes() const {
+  // Roughly, per input, its set node, its entry in `exectree->all_input`,
+  // and its entry in the input store, with a map node per argument.
+  static const size_t BYTES_PER_INPUT = 256;
+  static const size_t BYTES_PER_ARG = 80;
+  return tail.capacity() * sizeof(PCID) +
+         inputset.size() * (BYTES_PER_INPUT + params_size() * BYTES_PER_ARG);
+}
 
 InternalNode::InternalNode(ExecTree* exectree_) : Node(exectree_) {}
 bool InternalNode::struct_eq(const Node& other) const {
   if (!other.is_internal()) return false;
 
-  if (prefix != other.prefix) return false;
+  if (get_prefix() != other.get_prefix()) return false;
 
   const InternalNode* other_ = as_internal(&other);
 
@@ -342,47 +500,100 @@ bool InternalNode::struct_eq(const Node& other) const {
 
   return true;
 }
+static bool first_pcid_less(const std::unique_ptr<Node>& node, PCID pcid) {
+  return node->get_prefix()[0] < pcid;
+}
+static bool pcid_less_first(PCID pcid, const std::unique_ptr<Node>& node) {
+  return pcid < node->get_prefix()[0];
+}
+
 Node* InternalNode::add_child(std::unique_ptr<Node> node) {
   Node* node_raw = node.get();
+  PCID first = node->get_prefix()[0];
 
   node->parent = this;
+  path_conds_valid = false;
 
-  auto it = children.begin();
-  while (it != children.end()) {
-    if (it->get() == nullptr) {
-      it = children.erase(it);
-      continue;
-    }
-    if ((*it)->get_prefix()[0] > node->get_prefix()[0]) break;
-    ++it;
+  if (!children_dirty && lookup_child(first) != nullptr) children_dirty = true;
+
+  auto it = children.end();
+  if (!children_dirty) {
+    it = std::upper_bound(children.begin(), children.end(), first,
+                          pcid_less_first);
+  } else {
+    for (it = children.begin(); it != children.end(); ++it)
+      if ((*it)->get_prefix()[0] > first) break;
   }
-  it = children.insert(it, std::move(node));
+  children.insert(it, std::move(node));
+
+  if (children.size() == CHILD_INDEX_MIN)
+    reindex_children();
+  else if (children.size() > CHILD_INDEX_MIN)
+    child_index.emplace(first, node_raw);
 
-  update_enum_bvs();
+  invalidate_aggregates();
 
   return node_raw;
 }
-Node* InternalNode::lookup_child(PCID pcid) {
-  size_t match_idx;
-  for (match_idx = 0; match_idx < children.size(); match_idx++)
-    if (children[match_idx]->get_prefix()[0] == pcid) break;
+std::unique_ptr<Node> InternalNode::remove_child(Node* node) {
+  PCID first = node->get_prefix()[0];
 
-  if (match_idx == children.size()) {
-    return nullptr;
+  auto it = children.begin();
+  if (!children_dirty)
+    it = std::lower_bound(children.begin(), children.end(), first,
+                          first_pcid_less);
+  while (it != children.end() && it->get() != node) ++it;
+  assert(it != children.end());
+
+  std::unique_ptr<Node> removed = std::move(*it);
+  children.erase(it);
+  path_conds_valid = false;
+  invalidate_aggregates();
+
+  if (children.size() < CHILD_INDEX_MIN / 2) {
+    child_index.clear();
   } else {
-    return children[match_idx].get();
+    auto entry = child_index.find(first);
+    if (entry != child_index.end() && entry->second == node)
+      child_index.erase(entry);
   }
+
+  return removed;
 }
-Node* InternalNode::lookup_child(ExecPath prefix_) {
-  size_t match_idx;
-  for (match_idx = 0; match_idx < children.size(); match_idx++)
-    if (children[match_idx]->get_prefix() == prefix_) break;
+void InternalNode::reindex_children() {
+  child_index.clear();
+  if (children.size() < CHILD_INDEX_MIN) return;
 
-  if (match_idx == children.size()) {
+  for (auto& child : children)
+    child_index.emplace(child->get_prefix()[0], child.get());
+}
+Node* InternalNode::lookup_child(PCID pcid) {
+  if (children_dirty) {
+    for (auto& child : children)
+      if (child->get_prefix()[0] == pcid) return child.get();
     return nullptr;
-  } else {
-    return children[match_idx].get();
   }
+
+  if (!child_index.empty()) {
+    auto it = child_index.find(pcid);
+    return it == child_index.end() ? nullptr : it->second;
+  }
+
+  auto it =
+      std::lower_bound(children.begin(), children.end(), pcid, first_pcid_less);
+  if (it == children.end() || (*it)->get_prefix()[0] != pcid) return nullptr;
+  return it->get();
+}
+Node* InternalNode::lookup_child(ExecPathView prefix_) {
+  if (children_dirty) {
+    for (auto& child : children)
+      if (child->get_prefix() == prefix_) return child.get();
+    return nullptr;
+  }
+
+  Node* child = lookup_child(prefix_[0]);
+  if (child == nullptr || child->get_prefix() != prefix_) return nullptr;
+  return child;
 }
 void InternalNode::squeeze_children() {
   auto it = children.begin();
@@ -422,13 +633,14 @@ void InternalNode::initialize_children_cond(CondType condtype) {
 
   for (auto&& child : children) {
     if (condtype == CT_ENUM)
-      child->cond = std::make_unique<EnumCondition>();
+      child->set_cond(std::make_unique<EnumCondition>());
     else
-      child->cond = std::make_unique<NumericCondition>();
+      child->set_cond(std::make_unique<NumericCondition>());
   }
 }
-std::pair<Node*, ExecPath> InternalNode::find(ExecPath epath) {
+std::pair<Node*, ExecPathView> InternalNode::find(ExecPathView epath) {
   assert(epath.size() > 0);
+  ExecPathView prefix = get_prefix();
   assert(!prefix.empty());
   if (is_root() && prefix == EPSILON) {
     Node* matched_child = lookup_child(epath[0]);
@@ -444,13 +656,12 @@ std::pair<Node*, ExecPath> InternalNode::find(ExecPath epath) {
     if (epsilon_child != nullptr) {
       return epsilon_child->find(EPSILON);
     } else {
-      return std::make_pair(this, ExecPath());
+      return std::make_pair(this, ExecPathView());
     }
   }
   size_t common_len = common_prefix_length(prefix, epath);
-  ExecPath common = subvec(prefix, 0, common_len);
-  ExecPath epath_rem = subvec(epath, common_len);
-  if (common != prefix) {
+  ExecPathView epath_rem = epath.subview(common_len);
+  if (common_len != prefix.size()) {
     if (is_root()) {
       return std::make_pair(nullptr, epath);
     } else {
@@ -469,44 +680,49 @@ std::pair<Node*, ExecPath> InternalNode::find(ExecPath epath) {
 }
 bool InternalNode::is_internal() const { return true; }
 bool InternalNode::is_leaf() const { return false; }
-void InternalNode::update_enum_bvs() {
-  if (default_condtype() != CT_ENUM) return;
-
-  EnumArgBitVecArray enum_bvs_old = EnumArgBitVecArray(enum_bvs);
-  EnumArgBitVecArray enum_bvs_new = initial_enum_bvs(false);
-  for (auto&& child : children) enum_bvs_new.bit_or(child->get_enum_bvs());
-  if (enum_bvs_new != enum_bvs_old) {
-    enum_bvs = std::move(enum_bvs_new);
-    if (!is_root()) parent->update_enum_bvs();
+void InternalNode::refresh_aggregates() const {
+  if (aggregates_valid) return;
+
+  bool is_enum = default_condtype() == CT_ENUM;
+  if (is_enum) enum_bvs = initial_enum_bvs(false);
+  height = 0;
+  num_leaves = 0;
+  num_inputs = 0;
+  for (auto&& child : children) {
+    child->refresh_aggregates();
+    if (is_enum) enum_bvs.bit_or(child->enum_bvs);
+    height = std::max(height, child->height + 1);
+    num_leaves += child->num_leaves;
+    num_inputs += child->num_inputs;
   }
+  aggregates_valid = true;
 }
-void InternalNode::update_depth() {
-  if (is_root()) {
-    depth = 0;
-  } else {
-    depth = parent->depth + 1;
+void InternalNode::invalidate_aggregates() {
+  for (InternalNode* node = this; node != nullptr && node->aggregates_valid;
+       node = node->parent) {
+    node->aggregates_valid = false;
+    node->inputset_summary.reset();
   }
-
-  for (auto&& child : children)
-    if (child->get_depth() != depth + 1) child->update_depth();
-};
+}
 void InternalNode::filter_nd_pcid(TracePC* tpc, size_t prefix_len_so_far,
                                   std::set<Node*>& filtered_nodes) {
   assert(tpc != nullptr);
-  size_t prefix_len;
+  ExecPathView prefix = get_prefix();
+  size_t prefix_len = prefix.size();
   if (prefix == Node::EPSILON) {
     assert(is_root());
     prefix_len = 0;
   } else {
-    size_t size_before = prefix.size();
-    prefix = tpc->Prune(prefix);
-    if (prefix.size() != size_before) {
+    ExecPath pruned = tpc->Prune(prefix);
+    if (pruned.size() != prefix.size()) {
       filtered_nodes.insert(this);
-      if (prefix.size() == 0) {
-        prefix = Node::EPSILON;
+      if (!is_root()) parent->children_dirty = true;
+      if (pruned.size() == 0) {
+        set_prefix(Node::EPSILON);
         prefix_len = 0;
       } else {
-        prefix_len = prefix.size();
+        set_prefix(pruned);
+        prefix_len = pruned.size();
       }
     }
   }
@@ -535,9 +751,9 @@ bool InternalNode::has_two_or_more_children(bool recursive) const {
 void InternalNode::init_cond_of_paired_siblings() {
   if (children.size() == 2) {
     if (*children[0]->cond == *default_branch_condition()) {
-      children[1]->cond = default_branch_condition();
+      children[1]->set_cond(default_branch_condition());
     } else if (*children[1]->cond == *default_branch_condition()) {
-      children[0]->cond = default_branch_condition();
+      children[0]->set_cond(default_branch_condition());
     }
   }
 
@@ -555,13 +771,33 @@ std::string InternalNode::to_string(bool print_prefix) const {
   return str;
 }
 std::set<Input> InternalNode::get_inputset() {
-  std::set<Input> gathered;
+  if (!inputset_summary.has_value()) {
+    // Only kept while valid, to be dropped on invalidation.
+    refresh_aggregates();
+    std::set<Input> gathered;
+    gather_inputset(gathered);
+    inputset_summary = std::move(gathered);
+  }
+  return inputset_summary.value();
+}
+void InternalNode::gather_inputset(std::set<Input>& gathered) {
+  // Summaries of internal nodes below are used if there, but not made, so
+  // that the inputs of a leaf are not copied into all of its ancestors.
   for (auto&& child : children) {
     assert(child != nullptr);
-    std::set<Input> inputset_ = child->get_inputset();
-    gathered.insert(inputset_.begin(), inputset_.end());
+    if (child->is_leaf()) {
+      std::set<Input> inputset_ = child->get_inputset();
+      gathered.insert(inputset_.begin(), inputset_.end());
+      continue;
+    }
+
+    InternalNode* internal = as_internal(child.get());
+    if (internal->inputset_summary.has_value())
+      gathered.insert(internal->inputset_summary->begin(),
+                      internal->inputset_summary->end());
+    else
+      internal->gather_inputset(gathered);
   }
-  return gathered;
 }
 
 InternalNode* as_internal(Node* node) {
@@ -589,54 +825,56 @@ const LeafNode* as_leaf(const Node* node) {
   return leaf;
 }
 
-ExecTree::ExecTree(TracePC* tpc_) : tpc(tpc_) {}
+ExecTree::ExecTree(TracePC* tpc_) : tpc(tpc_), prefix_pool(Node::EPSILON) {
+  compacted_pool_size = prefix_pool.size();
+}
 bool ExecTree::is_empty() const { return root == nullptr; }
 void ExecTree::set_root(std::unique_ptr<Node> root_) {
   root = std::move(root_);
-  root->depth = 0;
 }
 Node* ExecTree::get_root() const { return root.get(); }
 
-std::unique_ptr<LeafNode> ExecTree::create_leaf(ExecPath prefix) {
+std::unique_ptr<LeafNode> ExecTree::create_leaf(ExecPathView prefix) {
   std::unique_ptr<LeafNode> leaf = std::make_unique<LeafNode>(this);
-  leaf->prefix = prefix;
+  leaf->set_prefix(prefix);
   leaf->enum_bvs = initial_enum_bvs(false);
 
   return std::move(leaf);
 }
-std::unique_ptr<InternalNode> ExecTree::create_internal(ExecPath prefix) {
+std::unique_ptr<InternalNode> ExecTree::create_internal(ExecPathView prefix) {
   std::unique_ptr<InternalNode> internal = std::make_unique<InternalNode>(this);
-  internal->prefix = prefix;
+  internal->set_prefix(prefix);
   internal->enum_bvs = initial_enum_bvs(false);
 
   return std::move(internal);
 }
 Node* ExecTree::add_node(std::unique_ptr<Node> node, InternalNode* parent,
                          std::unique_ptr<BranchCondition> cond) {
-  assert(!node->prefix.empty());
+  assert(!node->get_prefix().empty());
 
   Node* node_raw = node.get();
 
-  if (node->is_internal()) {
-    internals.insert(as_internal(node_raw));
-  } else {
+  register_node(node_raw);
+  node_raw->invalidate_path_cache();
+  if (node->is_leaf()) {
     LeafNode* node_raw_ = as_leaf(node_raw);
-    leaves.insert(node_raw_);
-    for (auto&& input : node_raw_->inputset) all_input[input] = node_raw_;
+    assert(!node_raw_->is_spilled());
+    for (auto& input : node_raw_->inputset) index_input(input, node_raw_);
   }
 
+  // Conditions are set once attached, as a pulled node keeps its old parent.
   if (parent == nullptr) {
     // Root node
-    node->cond = std::make_unique<NeglectCondition>();
     assert(root == nullptr);  // previous root must be moved already
     root = std::move(node);
     root->parent = nullptr;
+    root->set_cond(std::make_unique<NeglectCondition>());
   } else {
-    node->cond = cond != nullptr ? std::move(cond) : default_branch_condition();
     parent->add_child(std::move(node));
+    node_raw->set_cond(cond != nullptr ? std::move(cond)
+                                       : default_branch_condition());
     parent->mark_exception();
   }
-  node_raw->update_depth();
   return node_raw;
 }
 void ExecTree::add_nodes(std::vector<std::unique_ptr<Node>> nodes,
@@ -645,95 +883,191 @@ void ExecTree::add_nodes(std::vector<std::unique_ptr<Node>> nodes,
 }
 std::unique_ptr<Node> ExecTree::pull_node(Node* node) {
   assert(node != nullptr);
+  assert(has(node));
 
-  if (node->is_internal()) {
-    assert(internals.find(as_internal(node)) != internals.end());
-    internals.erase(as_internal(node));
-  } else {
-    assert(leaves.find(as_leaf(node)) != leaves.end());
-    leaves.erase(as_leaf(node));
-    for (auto&& input : as_leaf(node)->inputset) all_input.erase(input);
-  }
+  // Paged in, as its inputs would be freed along with their entries.
+  if (node->is_leaf()) page_in(as_leaf(node));
+  unregister_node(node);
+  node->invalidate_path_cache();
+  if (node->is_leaf())
+    for (auto& input : as_leaf(node)->inputset)
+      all_input.erase(input.get_id());
 
   if (node->is_root()) return std::move(root);
 
-  InternalNode* parent = node->parent;
-
-  size_t match_idx;
-  for (match_idx = 0; match_idx < parent->children.size(); match_idx++)
-    if (parent->children[match_idx].get() == node) break;
-
-  assert(match_idx < parent->children.size());
-
-  std::unique_ptr<Node> pulled = std::move(parent->children[match_idx]);
-  parent->squeeze_children();
-
+  std::unique_ptr<Node> pulled = node->parent->remove_child(node);
   assert(pulled != nullptr);
 
   return pulled;
 }
 std::vector<std::unique_ptr<Node>> ExecTree::pull_children(Node* node) {
   assert(node->is_internal());
+  InternalNode* internal = as_internal(node);
+
+  for (auto& child : internal->children) {
+    assert(has(child.get()));
+    if (child->is_leaf()) page_in(as_leaf(child.get()));
+    unregister_node(child.get());
+    child->invalidate_path_cache();
+    if (child->is_leaf())
+      for (auto& input : as_leaf(child.get())->inputset)
+        all_input.erase(input.get_id());
+  }
 
-  std::vector<Node*> children_raw;
-  for (auto& child : as_internal(node)->children)
-    children_raw.push_back(child.get());
-
-  std::vector<std::unique_ptr<Node>> pulled;
-  for (auto& child : children_raw) pulled.push_back(pull_node(child));
+  std::vector<std::unique_ptr<Node>> pulled = std::move(internal->children);
+  internal->children.clear();
+  internal->child_index.clear();
+  internal->children_dirty = false;
+  internal->invalidate_aggregates();
 
   return std::move(pulled);
 }
-Node* ExecTree::insert(ExecPath epath, Input input, int run_status) {
-  return insert(epath, std::set<Input>({input}), run_status);
+Node* ExecTree::insert(ExecPathView epath, Input input, int run_status,
+                       bool must_keep) {
+  return insert(epath, std::set<Input>({input}), run_status, must_keep);
+}
+Node* ExecTree::insert(ExecPathView epath, std::set<Input> inputset,
+                       int run_status, bool must_keep) {
+  uint64_t path_hash = tpc->PathHash(epath);
+  Node* leaf = insert_leaf(epath, std::move(inputset), run_status, must_keep);
+  index_path(as_leaf(leaf), path_hash);
+  compact_prefix_pool();
+  enforce_memory_budget();
+  return leaf;
 }
-Node* ExecTree::insert(ExecPath epath, std::set<Input> inputset,
-                       int run_status) {
-  ExecPath epath_significant = tpc->significant(epath);
-  ExecPath epath_tail = tpc->tail_of(epath);
+void ExecTree::bulk_insert(std::vector<PathEntry> entries) {
+  if (!is_empty()) {
+    for (auto& entry : entries)
+      insert(entry.epath, std::move(entry.inputset), entry.run_status);
+    return;
+  }
+  if (entries.empty()) return;
+
+  // An empty tree is built at once from the sorted paths, rather than by
+  // splitting nodes insertion after insertion. Entries of the same path are
+  // kept in order, so that they end up in its leaf as if inserted one by one.
+  std::stable_sort(entries.begin(), entries.end(),
+                   [this](const PathEntry& left, const PathEntry& right) {
+                     ExecPathView left_ = tpc->significant(left.epath);
+                     ExecPathView right_ = tpc->significant(right.epath);
+                     return std::lexicographical_compare(
+                         left_.begin(), left_.end(), right_.begin(),
+                         right_.end());
+                   });
+  std::vector<size_t> group_begin;
+  for (size_t i = 0; i < entries.size(); i++) {
+    assert(!entries[i].epath.empty());
+    if (i == 0 || tpc->significant(entries[i].epath) !=
+                      tpc->significant(entries[i - 1].epath))
+      group_begin.push_back(i);
+  }
+  size_t num_groups = group_begin.size();
+  group_begin.push_back(entries.size());
+
+  add_node(build_subtree(entries, group_begin, 0, num_groups, 0), nullptr);
+  compact_prefix_pool();
+  enforce_memory_budget();
+}
+std::unique_ptr<Node> ExecTree::build_subtree(
+    std::vector<PathEntry>& entries, const std::vector<size_t>& group_begin,
+    size_t lo, size_t hi, size_t offset) {
+  // Builds the subtree of the paths of groups in [lo, hi), which share their
+  // first `offset` PCIDs. Nodes are registered, but left detached.
+  auto path_of = [&](size_t group) {
+    return tpc->significant(entries[group_begin[group]].epath);
+  };
+  ExecPathView first = path_of(lo);
+
+  if (hi - lo == 1) {
+    std::unique_ptr<LeafNode> leaf = create_leaf(
+        first.size() == offset ? ExecPathView(Node::EPSILON)
+                               : first.subview(offset));
+    for (size_t i = group_begin[lo]; i < group_begin[lo + 1]; i++)
+      leaf->insert_inputset(tpc->tail_of(entries[i].epath),
+                            std::move(entries[i].inputset),
+                            entries[i].run_status);
+    register_node(leaf.get());
+    for (auto& input : leaf->inputset) index_input(input, leaf.get());
+    index_path(leaf.get(), tpc->PathHash(first));
+    return std::move(leaf);
+  }
+
+  // Paths are sorted, so the first and the last share what all share.
+  ExecPathView last = path_of(hi - 1);
+  size_t end = offset;
+  while (end < first.size() && end < last.size() && first[end] == last[end])
+    end++;
+  assert(offset == 0 || end > offset);
+
+  std::unique_ptr<InternalNode> internal =
+      create_internal(end == offset ? ExecPathView(Node::EPSILON)
+                                    : first.subview(offset, end - offset));
+  register_node(internal.get());
+  for (size_t i = lo; i < hi;) {
+    // Only the first path may stop here, as an epsilon child.
+    size_t j = i + 1;
+    if (path_of(i).size() > end)
+      while (j < hi && path_of(j)[end] == path_of(i)[end]) j++;
+
+    std::unique_ptr<Node> child =
+        build_subtree(entries, group_begin, i, j, end);
+    child->set_cond(default_branch_condition());
+    child->parent = internal.get();
+    internal->children.push_back(std::move(child));
+    i = j;
+  }
+  internal->reindex_children();
+  internal->mark_exception();
+  return std::move(internal);
+}
+Node* ExecTree::insert_leaf(ExecPathView epath, std::set<Input> inputset,
+                            int run_status, bool must_keep) {
+  ExecPathView epath_significant = tpc->significant(epath);
+  ExecPathView epath_tail = tpc->tail_of(epath);
   if (is_empty()) {
     // Case 1: First insertion.
     //         Init with a leaf node.
 
     std::unique_ptr<LeafNode> new_root = create_leaf(epath_significant);
-    new_root->insert_inputset(epath_tail, inputset, run_status);
+    new_root->insert_inputset(epath_tail, inputset, run_status, must_keep);
     return add_node(std::move(new_root), nullptr);
   }
 
   Node* nearest;
-  ExecPath epath_rem;
+  ExecPathView epath_rem;
   std::tie(nearest, epath_rem) = root->find(epath_significant);
 
   if (nearest == nullptr) {
     // Case 2: `epath` does not go through current root.
     //         Add an internal node as a new root, and add a new leaf node.
 
-    if (root->prefix == Node::EPSILON) {
+    if (root->get_prefix() == Node::EPSILON) {
       assert(root->is_internal() &&
              as_internal(root.get())->lookup_child(epath_rem[0]) == nullptr);
       assert(epath_rem == epath);
       std::unique_ptr<LeafNode> new_leaf = create_leaf(epath_rem);
-      new_leaf->insert_inputset(epath_tail, inputset, run_status);
+      new_leaf->insert_inputset(epath_tail, inputset, run_status, must_keep);
       Node* new_leaf_ = add_node(std::move(new_leaf), as_internal(root.get()));
       as_internal(root.get())->initialize_children_cond(default_condtype());
       return new_leaf_;
     }
 
-    size_t common_len = common_prefix_length(root->prefix, epath_rem);
-    ExecPath common =
-        common_len == 0 ? Node::EPSILON : subvec(root->prefix, 0, common_len);
+    size_t common_len = common_prefix_length(root->get_prefix(), epath_rem);
+    ExecPathView common =
+        common_len == 0 ? ExecPathView(Node::EPSILON)
+                        : root->get_prefix().subview(0, common_len);
 
     std::unique_ptr<InternalNode> new_root = create_internal(common);
     std::unique_ptr<Node> old_root = pull_node(root.get());
-    assert(old_root->prefix.size() > common_len);
-    old_root->prefix = subvec(old_root->prefix, common_len);
+    assert(old_root->get_prefix().size() > common_len);
+    if (common_len > 0) old_root->drop_prefix(common_len);
     add_node(std::move(old_root), new_root.get());
     Node* new_root_ = add_node(std::move(new_root), nullptr);
 
-    epath_rem = epath_rem.size() == common_len ? Node::EPSILON
-                                               : subvec(epath_rem, common_len);
+    epath_rem = epath_rem.size() == common_len ? ExecPathView(Node::EPSILON)
+                                               : epath_rem.subview(common_len);
     std::unique_ptr<LeafNode> new_leaf = create_leaf(epath_rem);
-    new_leaf->insert_inputset(epath_tail, inputset, run_status);
+    new_leaf->insert_inputset(epath_tail, inputset, run_status, must_keep);
     Node* new_leaf_ = add_node(std::move(new_leaf), as_internal(new_root_));
     as_internal(new_root_)->initialize_children_cond(default_condtype());
     return new_leaf_;
@@ -745,14 +1079,15 @@ Node* ExecTree::insert(ExecPath epath, std::set<Input> inputset,
       //         Add a new leaf with epsilon prefix.
 
       std::unique_ptr<LeafNode> new_leaf = create_leaf(Node::EPSILON);
-      new_leaf->insert_inputset(epath_tail, inputset, run_status);
+      new_leaf->insert_inputset(epath_tail, inputset, run_status, must_keep);
       return add_node(std::move(new_leaf), as_internal(nearest));
     } else {
       // Case 4: Found an existing leaf.
       //         Insert `input` to it.
 
       Node* leaf = nearest;
-      as_leaf(leaf)->insert_inputset(epath_tail, inputset, run_status);
+      as_leaf(leaf)->insert_inputset(epath_tail, inputset, run_status,
+                                     must_keep);
       return leaf;
     }
   }
@@ -764,7 +1099,7 @@ Node* ExecTree::insert(ExecPath epath, std::set<Input> inputset,
       // Case 5: Add a new leaf to exising internal node `nearest`.
 
       std::unique_ptr<LeafNode> leaf = create_leaf(epath_rem);
-      leaf->insert_inputset(epath_tail, inputset, run_status);
+      leaf->insert_inputset(epath_tail, inputset, run_status, must_keep);
       return add_node(std::move(leaf), nearest_);
     } else {
       // Case 6: Add a new internal node between `nearest` and one of its
@@ -773,22 +1108,23 @@ Node* ExecTree::insert(ExecPath epath, std::set<Input> inputset,
 
       std::unique_ptr<Node> pulled = pull_node(matched_child);
 
-      size_t common_len = common_prefix_length(pulled->prefix, epath_rem);
-      assert(0 < common_len && common_len < pulled->prefix.size());
-      ExecPath common = subvec(pulled->prefix, 0, common_len);
+      ExecPathView pulled_prefix = pulled->get_prefix();
+      size_t common_len = common_prefix_length(pulled_prefix, epath_rem);
+      assert(0 < common_len && common_len < pulled_prefix.size());
+      ExecPathView common = pulled_prefix.subview(0, common_len);
 
       std::unique_ptr<InternalNode> internal = create_internal(common);
       std::unique_ptr<BranchCondition> internal_cond = std::move(pulled->cond);
-      pulled->prefix = subvec(pulled->prefix, common_len);
+      pulled->drop_prefix(common_len);
       add_node(std::move(pulled), internal.get());
       Node* internal_ =
           add_node(std::move(internal), nearest_, std::move(internal_cond));
 
       epath_rem = epath_rem.size() == common_len
-                      ? Node::EPSILON
-                      : subvec(epath_rem, common_len);
+                      ? ExecPathView(Node::EPSILON)
+                      : epath_rem.subview(common_len);
       std::unique_ptr<LeafNode> leaf = create_leaf(epath_rem);
-      leaf->insert_inputset(epath_tail, inputset, run_status);
+      leaf->insert_inputset(epath_tail, inputset, run_status, must_keep);
       return add_node(std::move(leaf), as_internal(internal_));
     }
   }
@@ -799,68 +1135,78 @@ Node* ExecTree::insert(ExecPath epath, std::set<Input> inputset,
     //         And a new leaf to the internal node.
 
     std::unique_ptr<Node> pulled = pull_node(nearest);
-    std::unique_ptr<InternalNode> internal = create_internal(pulled->prefix);
+    std::unique_ptr<InternalNode> internal =
+        create_internal(pulled->get_prefix());
     InternalNode* internal_parent = pulled->parent;
     std::unique_ptr<BranchCondition> internal_cond = std::move(pulled->cond);
-    pulled->prefix = Node::EPSILON;
+    pulled->set_prefix(Node::EPSILON);
     add_node(std::move(pulled), internal.get());
 
     std::unique_ptr<LeafNode> leaf = create_leaf(epath_rem);
-    leaf->insert_inputset(epath_tail, inputset, run_status);
+    leaf->insert_inputset(epath_tail, inputset, run_status, must_keep);
     Node* leaf_ = add_node(std::move(leaf), internal.get());
 
     add_node(std::move(internal), internal_parent, std::move(internal_cond));
     return leaf_;
   }
 }
-std::unique_ptr<Node> ExecTree::purge_leaf(ExecPath epath) {
+std::unique_ptr<Node> ExecTree::purge_leaf(ExecPathView epath) {
   Node* leaf_raw = find(epath);
   assert(leaf_raw != nullptr);
   assert(leaf_raw->is_leaf());
 
   InternalNode* parent = leaf_raw->parent;
+  unindex_path(as_leaf(leaf_raw));
   std::unique_ptr<Node> leaf = pull_node(leaf_raw);
 
   if (parent != nullptr) rm_internal_with_only_child(parent);
 
   return std::move(leaf);
 }
-void ExecTree::purge_and_reinsert(ExecPath epath_old, ExecPath epath_new) {
+void ExecTree::purge_and_reinsert(ExecPathView epath_old,
+                                  ExecPathView epath_new) {
   std::unique_ptr<Node> leaf_old = purge_leaf(epath_old);
-  std::set<Input> inputset = as_leaf(leaf_old.get())->inputset;
+  std::set<Input> inputset = as_leaf(leaf_old.get())->get_inputset();
   bool exception_path = leaf_old->exception_path;
   Node* leaf_new = insert(epath_new, inputset, exception_path);
 }
-const std::set<InternalNode*>& ExecTree::get_internals() const {
+const std::vector<InternalNode*>& ExecTree::get_internals() const {
   return internals;
 }
-const std::set<LeafNode*>& ExecTree::get_leaves() const { return leaves; }
+const std::vector<LeafNode*>& ExecTree::get_leaves() const { return leaves; }
 LeafNode* ExecTree::get_leaf(Input input) {
   assert(has(input));
-  return all_input[input];
+  return leaf_of(input);
 }
-Node* ExecTree::find(ExecPath epath) {
+Node* ExecTree::find(ExecPathView epath) {
   Node* nearest;
-  ExecPath epath_rem;
+  ExecPathView epath_rem;
   std::tie(nearest, epath_rem) = root->find(tpc->significant(epath));
 
   if (epath_rem.size() > 0) return nullptr;
   return nearest;
 }
-bool ExecTree::has(ExecPath epath) {
+LeafNode* ExecTree::find_leaf(ExecPathView epath, uint64_t path_hash) {
+  auto range = path_index.equal_range(path_hash);
+  for (auto it = range.first; it != range.second; ++it)
+    if (is_path_of(it->second, epath)) return it->second;
+  return nullptr;
+}
+bool ExecTree::has(ExecPathView epath) {
+  return has(epath, tpc->PathHash(epath));
+}
+bool ExecTree::has(ExecPathView epath, uint64_t path_hash) {
   if (is_empty()) return false;
 
-  return find(epath) != nullptr;
-}
-bool ExecTree::has(Input input) {
-  return all_input.find(input) != all_input.end();
+  return find_leaf(epath, path_hash) != nullptr;
 }
+bool ExecTree::has(Input input) { return leaf_of(input) != nullptr; }
 ExecPath ExecTree::get_path(Input input) {
-  LeafNode* leaf = all_input.find(input)->second;
+  LeafNode* leaf = leaf_of(input);
   assert(leaf != nullptr);
-  return vec_concat(leaf->get_path_log(true), leaf->tail);
+  return vec_concat(leaf->get_path_log(true), leaf->get_tail().to_vec());
 }
-std::vector<Node*> ExecTree::get_nodes(ExecPath epath) {
+std::vector<Node*> ExecTree::get_nodes(ExecPathView epath) {
   // gather nodes along epath.
   // `epath` may involve epsilon child.
 
@@ -873,12 +1219,12 @@ std::vector<Node*> ExecTree::get_nodes(ExecPath epath) {
   while (true) {
     nodes.push_back(current);
 
-    size_t common_len = common_prefix_length(current->prefix, epath);
-    ExecPath common = subvec(current->prefix, 0, common_len);
-    epath = subvec(epath, common_len);
+    ExecPathView prefix = current->get_prefix();
+    size_t common_len = common_prefix_length(prefix, epath);
+    epath = epath.subview(common_len);
 
-    if (common != current->prefix) {
-      assert(current == root.get() && root->prefix == Node::EPSILON);
+    if (common_len != prefix.size()) {
+      assert(current == root.get() && prefix == Node::EPSILON);
     }
 
     if (current->is_leaf()) {
@@ -890,7 +1236,7 @@ std::vector<Node*> ExecTree::get_nodes(ExecPath epath) {
 
     if (epath.empty()) {
       assert(current_->children[0]->is_leaf() &&
-             current_->children[0]->prefix == Node::EPSILON);
+             current_->children[0]->get_prefix() == Node::EPSILON);
       nodes.push_back(current_->children[0].get());
       break;
     }
@@ -901,7 +1247,8 @@ std::vector<Node*> ExecTree::get_nodes(ExecPath epath) {
   }
   return nodes;
 }
-std::set<Node*> ExecTree::evaluate_conditions(Input input, ExecPath epath) {
+std::set<Node*> ExecTree::evaluate_conditions(Input input,
+                                              ExecPathView epath) {
   // returns nodes whose condition is not consistent with input
   std::vector<Node*> nodes = get_nodes(tpc->significant(epath));
   std::set<Node*> incorrect_nodes;
@@ -911,39 +1258,351 @@ std::set<Node*> ExecTree::evaluate_conditions(Input input, ExecPath epath) {
   }
   return incorrect_nodes;
 }
-std::set<Node*> ExecTree::get_all_nodes() const {
-  std::set<Node*> all_nodes;
-  all_nodes.insert(internals.begin(), internals.end());
-  all_nodes.insert(leaves.begin(), leaves.end());
-  return all_nodes;
+bool ExecTree::is_path_of(const LeafNode* leaf, ExecPathView epath) const {
+  // Compare the significant part of `epath` with prefixes along `leaf`,
+  // without concatenating them.
+  std::vector<const Node*> nodes;
+  for (const Node* node = leaf; node != nullptr; node = node->parent)
+    nodes.push_back(node);
+
+  size_t size = std::min(epath.size(), tpc->ExecPathSignificantMax());
+  size_t pos = 0;
+  for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+    ExecPathView prefix = (*it)->get_prefix();
+    if (prefix == Node::EPSILON) continue;
+    if (pos + prefix.size() > size ||
+        !std::equal(prefix.begin(), prefix.end(), epath.begin() + pos))
+      return false;
+    pos += prefix.size();
+  }
+  return pos == size;
+}
+void ExecTree::index_path(LeafNode* leaf, uint64_t path_hash) {
+  auto range = path_index.equal_range(path_hash);
+  for (auto it = range.first; it != range.second; ++it)
+    if (it->second == leaf) return;
+
+  leaf->path_hash = path_hash;
+  path_index.emplace(path_hash, leaf);
+}
+void ExecTree::unindex_path(LeafNode* leaf) {
+  auto range = path_index.equal_range(leaf->path_hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == leaf) {
+      path_index.erase(it);
+      return;
+    }
+  }
 }
-bool ExecTree::has(Node* node) const {
-  if (internals.find(static_cast<InternalNode*>(node)) != internals.end()) {
-    return true;
-  } else if (leaves.find(static_cast<LeafNode*>(node)) != leaves.end()) {
+void ExecTree::rebuild_path_index() {
+  path_index.clear();
+  for (auto& leaf : leaves)
+    index_path(leaf, tpc->PathHash(leaf->get_path_log(true)));
+}
+void ExecTree::index_pcids(Node* node, ExecPathView epath) {
+  if (epath == Node::EPSILON) return;
+
+  for (PCID pcid : epath) {
+    if (pcid >= pcid_index.size()) pcid_index.resize(pcid + 1);
+    std::vector<uint32_t>& ids = pcid_index[pcid];
+    if (!ids.empty() && ids.back() == node->id) continue;
+    ids.push_back(node->id);
+    pcid_index_size++;
+  }
+}
+void ExecTree::rebuild_pcid_index() {
+  for (auto& ids : pcid_index) ids.clear();
+  pcid_index_size = 0;
+  for (auto& node : get_all_nodes()) {
+    index_pcids(node, node->get_prefix());
+    if (node->is_leaf()) index_pcids(node, as_leaf(node)->get_tail());
+  }
+  rebuilt_pcid_index_size = pcid_index_size;
+}
+bool ExecTree::contains_pcid(Node* node, PCID pcid) const {
+  ExecPathView prefix = node->get_prefix();
+  if (std::find(prefix.begin(), prefix.end(), pcid) != prefix.end())
     return true;
+  if (node->is_leaf()) {
+    ExecPathView tail = as_leaf(node)->get_tail();
+    return std::find(tail.begin(), tail.end(), pcid) != tail.end();
   }
   return false;
 }
+std::vector<Node*> ExecTree::lookup_pcid(PCID pcid) {
+  if (pcid >= pcid_index.size()) return {};
+
+  // Drop stale entries on the way.
+  std::vector<uint32_t>& ids = pcid_index[pcid];
+  std::vector<Node*> nodes;
+  size_t num_kept = 0;
+  for (uint32_t id : ids) {
+    if (!has_id(id) || !contains_pcid(node_of_id[id], pcid)) continue;
+    ids[num_kept++] = id;
+    nodes.push_back(node_of_id[id]);
+  }
+  pcid_index_size -= ids.size() - num_kept;
+  ids.resize(num_kept);
+  return nodes;
+}
+void ExecTree::collect_leaves(Node* node,
+                              std::set<uint32_t>& leaf_ids) const {
+  if (node->is_leaf()) {
+    leaf_ids.insert(node->id);
+    return;
+  }
+  for (auto& child : as_internal(node)->children)
+    collect_leaves(child.get(), leaf_ids);
+}
+PrefixSlice ExecTree::intern_prefix(ExecPathView prefix) {
+  if (prefix == Node::EPSILON) return {0, 1};
+
+  // Slices of the pool are shared rather than copied.
+  uintptr_t begin = (uintptr_t)prefix_pool.data();
+  uintptr_t end = (uintptr_t)(prefix_pool.data() + prefix_pool.size());
+  uintptr_t data = (uintptr_t)prefix.data();
+  if (begin <= data && data < end) {
+    assert(data + prefix.size() * sizeof(PCID) <= end);
+    return {(uint32_t)(prefix.data() - prefix_pool.data()),
+            (uint32_t)prefix.size()};
+  }
+
+  PrefixSlice slice = {(uint32_t)prefix_pool.size(), (uint32_t)prefix.size()};
+  prefix_pool.insert(prefix_pool.end(), prefix.begin(), prefix.end());
+  return slice;
+}
+void ExecTree::compact_prefix_pool() {
+  // Views into the pool are invalidated, so this is only called between
+  // operations on the tree.
+  if (pcid_index_size >= 2 * rebuilt_pcid_index_size + 4096)
+    rebuild_pcid_index();
+  if (prefix_pool.size() < 2 * compacted_pool_size + 4096) return;
+
+  ExecPath pool = Node::EPSILON;
+  for (auto& node : get_all_nodes()) {
+    ExecPathView prefix = node->get_prefix();
+    if (prefix == Node::EPSILON) {
+      node->prefix = {0, 1};
+      continue;
+    }
+    node->prefix = {(uint32_t)pool.size(), (uint32_t)prefix.size()};
+    pool.insert(pool.end(), prefix.begin(), prefix.end());
+  }
+  prefix_pool = std::move(pool);
+  compacted_pool_size = prefix_pool.size();
+}
+void ExecTree::account(LeafNode* leaf) {
+  if (!has(leaf)) return;
+  resident_bytes -= leaf->resident_bytes;
+  leaf->resident_bytes = leaf->estimate_bytes();
+  resident_bytes += leaf->resident_bytes;
+}
+// A spilled leaf is a record of words: the length of the tail, the tail, the
+// number of inputs and of values per input, then the values of each input,
+// split into two words each.
+void ExecTree::spill(LeafNode* leaf) {
+  assert(!leaf->is_spilled());
+  if (spill_file == nullptr) spill_file = std::make_unique<SpillFile>();
+
+  std::vector<uint32_t> words;
+  words.push_back(leaf->tail.size());
+  words.insert(words.end(), leaf->tail.begin(), leaf->tail.end());
+  words.push_back(leaf->inputset.size());
+  words.push_back(params_size());
+  for (auto& input : leaf->inputset) {
+    for (long value : serialize(input)) {
+      words.push_back((uint64_t)value);
+      words.push_back((uint64_t)value >> 32);
+    }
+    // Only inputs found in this leaf, as an input is found in one leaf.
+    auto it = all_input.find(input.get_id());
+    if (it == all_input.end() || it->second.leaf != leaf) continue;
+    all_input.erase(it);
+    spilled_input.insert({input.get_hash(), leaf});
+  }
+
+  if (leaf->spill_offset != LeafNode::NOT_SPILLED &&
+      (leaf->spill_size != words.size() ||
+       !std::equal(words.begin(), words.end(),
+                   spill_file->at(leaf->spill_offset))))
+    free_spill_record(leaf);
+  if (leaf->spill_offset == LeafNode::NOT_SPILLED) {
+    leaf->spill_offset = spill_file->write(words);
+    leaf->spill_size = words.size();
+  }
+  leaf->spilled = true;
+  leaf->inputset.clear();
+  leaf->tail = ExecPath();
+  account(leaf);
+}
+void ExecTree::page_in(LeafNode* leaf) {
+  leaf->last_used = ++use_clock;
+  if (!leaf->is_spilled()) return;
+
+  leaf->tail = spilled_tail(leaf).to_vec();
+  std::set<Input> inputset = spilled_inputset(leaf);
+  leaf->inputset.assign(inputset.begin(), inputset.end());
+  leaf->spilled = false;
+  for (auto& input : leaf->inputset) {
+    auto range = spilled_input.equal_range(input.get_hash());
+    for (auto it = range.first; it != range.second; it++) {
+      if (it->second == leaf) {
+        spilled_input.erase(it);
+        all_input.insert({input.get_id(), {input, leaf}});
+        break;
+      }
+    }
+  }
+  account(leaf);
+}
+void ExecTree::free_spill_record(LeafNode* leaf) {
+  assert(!leaf->is_spilled());
+  if (leaf->spill_offset == LeafNode::NOT_SPILLED) return;
+  spill_file->free(leaf->spill_offset, leaf->spill_size);
+  leaf->spill_offset = LeafNode::NOT_SPILLED;
+  leaf->spill_size = 0;
+}
+void ExecTree::enforce_memory_budget() {
+  size_t budget = MEMORY_BUDGET << 20;
+  if (budget == 0 || resident_bytes <= budget) return;
+
+  // Spill down to 3/4 of the budget, not to hit it again right away.
+  std::vector<LeafNode*> resident;
+  for (auto& leaf : leaves)
+    if (!leaf->is_spilled() && leaf->resident_bytes > 0)
+      resident.push_back(leaf);
+  std::sort(resident.begin(), resident.end(),
+            [](LeafNode* left, LeafNode* right) {
+              return left->last_used < right->last_used;
+            });
+  for (auto& leaf : resident) {
+    if (resident_bytes <= budget / 4 * 3) break;
+    spill(leaf);
+  }
+}
+ExecPathView ExecTree::spilled_tail(const LeafNode* leaf) const {
+  assert(leaf->is_spilled());
+  const uint32_t* record = spill_file->at(leaf->spill_offset);
+  return ExecPathView(record + 1, record[0]);
+}
+std::set<Input> ExecTree::spilled_inputset(const LeafNode* leaf) const {
+  assert(leaf->is_spilled());
+  const uint32_t* record = spill_file->at(leaf->spill_offset);
+  const uint32_t* words = record + 1 + record[0];
+  size_t num_inputs = words[0];
+  size_t num_values = words[1];
+  words += 2;
+
+  std::set<Input> inputset;
+  std::vector<long> values(num_values);
+  for (size_t i = 0; i < num_inputs; i++) {
+    for (auto& value : values) {
+      value = (long)(words[0] | (uint64_t)words[1] << 32);
+      words += 2;
+    }
+    std::optional<Input> input = deserialize(values);
+    assert(input.has_value());
+    inputset.insert(input.value());
+  }
+  return inputset;
+}
+bool ExecTree::spilled_has(const LeafNode* leaf, const Input& input) const {
+  assert(leaf->is_spilled());
+  const uint32_t* record = spill_file->at(leaf->spill_offset);
+  const uint32_t* words = record + 1 + record[0];
+  size_t num_inputs = words[0];
+  size_t num_values = words[1];
+  words += 2;
+
+  std::vector<long> values = serialize(input);
+  if (values.size() != num_values) return false;
+  for (size_t i = 0; i < num_inputs; i++, words += 2 * num_values) {
+    size_t j = 0;
+    while (j < num_values &&
+           (long)(words[2 * j] | (uint64_t)words[2 * j + 1] << 32) == values[j])
+      j++;
+    if (j == num_values) return true;
+  }
+  return false;
+}
+void ExecTree::index_input(const Input& input, LeafNode* leaf) {
+  all_input[input.get_id()] = {input, leaf};
+}
+LeafNode* ExecTree::leaf_of(const Input& input) const {
+  auto it = all_input.find(input.get_id());
+  if (it != all_input.end()) return it->second.leaf;
+
+  // Spilled inputs are told apart by their arguments, as hashes may collide.
+  auto range = spilled_input.equal_range(input.get_hash());
+  for (auto it = range.first; it != range.second; it++)
+    if (it->second->is_spilled() && spilled_has(it->second, input))
+      return it->second;
+  return nullptr;
+}
+void ExecTree::register_node(Node* node) {
+  if (has(node)) return;
+
+  node_of_id[node->id] = node;
+  if (node->is_internal()) {
+    node->registry_idx = internals.size();
+    internals.push_back(as_internal(node));
+  } else {
+    node->registry_idx = leaves.size();
+    leaves.push_back(as_leaf(node));
+    account(as_leaf(node));
+  }
+}
+void ExecTree::unregister_node(Node* node) {
+  assert(has(node));
+
+  node_of_id[node->id] = nullptr;
+  if (node->is_internal()) {
+    internals[node->registry_idx] = internals.back();
+    internals[node->registry_idx]->registry_idx = node->registry_idx;
+    internals.pop_back();
+  } else {
+    leaves[node->registry_idx] = leaves.back();
+    leaves[node->registry_idx]->registry_idx = node->registry_idx;
+    leaves.pop_back();
+    resident_bytes -= as_leaf(node)->resident_bytes;
+    as_leaf(node)->resident_bytes = 0;
+    // Leaves are paged in before being pulled, and may change before being
+    // added again.
+    free_spill_record(as_leaf(node));
+  }
+}
+std::vector<Node*> ExecTree::get_all_nodes() const {
+  std::vector<Node*> all_nodes;
+  all_nodes.reserve(internals.size() + leaves.size());
+  all_nodes.insert(all_nodes.end(), internals.begin(), internals.end());
+  all_nodes.insert(all_nodes.end(), leaves.begin(), leaves.end());
+  return all_nodes;
+}
+bool ExecTree::has(Node* node) const { return node_of_id[node->id] == node; }
+bool ExecTree::has_id(uint32_t id) const { return node_of_id[id] != nullptr; }
 void ExecTree::rm_internal_epsilon_node(InternalNode* internal) {
   assert(has(internal));
   assert(!internal->is_root());
 
-  if (internal->prefix != Node::EPSILON) return;
+  if (internal->get_prefix() != Node::EPSILON) return;
 
   InternalNode* parent = internal->parent;
   std::unique_ptr<Node> internal_epsilon_node = pull_node(internal);
   std::vector<std::unique_ptr<Node>> children = pull_children(internal);
   add_nodes(std::move(children), parent);
 }
-std::set<Node*> ExecTree::sort(InternalNode* internal) {
-  if (internal->children_sorted()) return {};
+std::set<uint32_t> ExecTree::sort(InternalNode* internal) {
+  if (internal->children_sorted()) {
+    internal->children_dirty = false;
+    internal->reindex_children();
+    return {};
+  }
 
-  std::set<Node*> merged_nodes;
+  std::set<uint32_t> merged_nodes;
 
   std::vector<std::unique_ptr<Node>> nodes = pull_children(internal);
   for (auto& node : nodes) {
-    Node* conflict = internal->lookup_child(node->prefix[0]);
+    Node* conflict = internal->lookup_child(node->get_prefix()[0]);
 
     if (conflict == nullptr) {
       add_node(std::move(node), internal);
@@ -953,7 +1612,7 @@ std::set<Node*> ExecTree::sort(InternalNode* internal) {
     std::unique_ptr<Node> conflicting_node = pull_node(conflict);
     std::unique_ptr<Node> merged_node =
         merge(std::move(conflicting_node), std::move(node));
-    merged_nodes.insert(merged_node.get());
+    merged_nodes.insert(merged_node->id);
     add_node(std::move(merged_node), internal);
   }
 
@@ -965,22 +1624,29 @@ std::unique_ptr<Node> ExecTree::merge(std::unique_ptr<Node> left,
   assert(!left->is_root() && !right->is_root());
   assert(left->parent == right->parent);
 
-  size_t common_len = common_prefix_length(left->prefix, right->prefix);
+  size_t common_len =
+      common_prefix_length(left->get_prefix(), right->get_prefix());
   assert(common_len > 0);
-  ExecPath common = subvec(left->prefix, 0, common_len);
+  // No prefix is interned before `common` is, so it stays valid.
+  ExecPathView common = left->get_prefix().subview(0, common_len);
 
-  if (left->prefix == right->prefix) {
-    ExecPath prefix = common;
-    assert(prefix == left->prefix);
+  if (left->get_prefix() == right->get_prefix()) {
+    ExecPathView prefix = common;
+    assert(prefix == left->get_prefix());
 
     if (left->is_leaf() && right->is_leaf()) {
       LeafNode* left_ = as_leaf(left.get());
       LeafNode* right_ = as_leaf(right.get());
 
+      unindex_path(left_);
+      unindex_path(right_);
+      page_in(left_);
+      page_in(right_);
       std::unique_ptr<LeafNode> new_leaf = create_leaf(prefix);
-      new_leaf->merge_inputset(std::move(left_->inputset));
-      new_leaf->merge_inputset(std::move(right_->inputset));
+      new_leaf->merge_inputset(std::move(left_->inputset), left_->num_seen);
+      new_leaf->merge_inputset(std::move(right_->inputset), right_->num_seen);
       new_leaf->tail = left_->tail;
+      index_pcids(new_leaf.get(), new_leaf->tail);
       new_leaf->exception_path = left_->exception_path;
       return std::move(new_leaf);
     }
@@ -988,13 +1654,13 @@ std::unique_ptr<Node> ExecTree::merge(std::unique_ptr<Node> left,
     assert(prefix != Node::EPSILON);
 
     if (left->is_leaf() && right->is_internal()) {
-      left->prefix = Node::EPSILON;
+      left->set_prefix(Node::EPSILON);
       add_node(std::move(left), as_internal(right.get()));
       return std::move(right);
     }
 
     if (left->is_internal() && right->is_leaf()) {
-      right->prefix = Node::EPSILON;
+      right->set_prefix(Node::EPSILON);
       add_node(std::move(right), as_internal(left.get()));
       return std::move(left);
     }
@@ -1008,33 +1674,33 @@ std::unique_ptr<Node> ExecTree::merge(std::unique_ptr<Node> left,
     return std::move(new_internal);
   }
 
-  if (left->prefix.size() == common_len) {
-    assert(right->prefix.size() > common_len);
+  if (left->get_prefix().size() == common_len) {
+    assert(right->get_prefix().size() > common_len);
     std::unique_ptr<InternalNode> new_internal = create_internal(common);
 
     if (left->is_leaf()) {
-      left->prefix = Node::EPSILON;
+      left->set_prefix(Node::EPSILON);
       add_node(std::move(left), new_internal.get());
     } else {
       add_nodes(std::move(as_internal(left.get())->children),
                 new_internal.get());
     }
 
-    right->prefix = subvec(right->prefix, common_len);
+    right->drop_prefix(common_len);
     add_node(std::move(right), new_internal.get());
 
     return std::move(new_internal);
   }
 
-  if (right->prefix.size() == common_len) {
-    assert(left->prefix.size() > common_len);
+  if (right->get_prefix().size() == common_len) {
+    assert(left->get_prefix().size() > common_len);
     std::unique_ptr<InternalNode> new_internal = create_internal(common);
 
-    left->prefix = subvec(left->prefix, common_len);
+    left->drop_prefix(common_len);
     add_node(std::move(left), new_internal.get());
 
     if (right->is_leaf()) {
-      right->prefix = Node::EPSILON;
+      right->set_prefix(Node::EPSILON);
       add_node(std::move(right), new_internal.get());
     } else {
       add_nodes(std::move(as_internal(right.get())->children),
@@ -1044,14 +1710,15 @@ std::unique_ptr<Node> ExecTree::merge(std::unique_ptr<Node> left,
     return std::move(new_internal);
   }
 
-  assert(left->prefix.size() > common_len && right->prefix.size() > common_len);
+  assert(left->get_prefix().size() > common_len &&
+         right->get_prefix().size() > common_len);
 
   std::unique_ptr<InternalNode> new_internal = create_internal(common);
 
-  left->prefix = subvec(left->prefix, common_len);
+  left->drop_prefix(common_len);
   add_node(std::move(left), new_internal.get());
 
-  right->prefix = subvec(right->prefix, common_len);
+  right->drop_prefix(common_len);
   add_node(std::move(right), new_internal.get());
 
   return std::move(new_internal);
@@ -1067,15 +1734,16 @@ void ExecTree::rm_internal_with_only_child(InternalNode* internal) {
   std::unique_ptr<Node> only_child =
       pull_node(as_internal(internal_with_only_child.get())->children[0].get());
 
-  if (internal_with_only_child->prefix == Node::EPSILON) {
+  if (internal_with_only_child->get_prefix() == Node::EPSILON) {
     assert(internal_with_only_child->is_root());
-    only_child->prefix = only_child->prefix;
-  } else if (only_child->prefix == Node::EPSILON) {
+  } else if (only_child->get_prefix() == Node::EPSILON) {
     assert(only_child->is_leaf());
     only_child->prefix = internal_with_only_child->prefix;
+    index_pcids(only_child.get(), only_child->get_prefix());
   } else {
-    only_child->prefix =
-        vec_concat(internal_with_only_child->prefix, only_child->prefix);
+    only_child->set_prefix(
+        vec_concat(internal_with_only_child->get_prefix().to_vec(),
+                   only_child->get_prefix().to_vec()));
   }
 
   add_node(std::move(only_child), parent);
@@ -1094,16 +1762,46 @@ std::set<Node*> ExecTree::invalid_condition_nodes() const {
   return invalid_nodes;
 }
 void ExecTree::prune() {
+  // Prunes PCIDs marked as nondeterministic since the last call.
   if (is_empty()) return;
 
-  bool recursive = true;
+  ExecPathView new_nd = tpc->GetNewND(num_nd_pruned);
+  num_nd_pruned += new_nd.size();
+
+  std::set<uint32_t> affected;
+  for (PCID pcid : new_nd)
+    for (Node* node : lookup_pcid(pcid)) affected.insert(node->id);
+
+  // Filtering a node filters its subtree, as tails of leaves below may be
+  // moved into their prefixes.
+  std::vector<Node*> targets;
+  for (uint32_t id : affected) {
+    bool below_affected = false;
+    for (Node* node = node_of_id[id]->parent; node != nullptr;
+         node = node->parent)
+      if (affected.find(node->id) != affected.end()) {
+        below_affected = true;
+        break;
+      }
+    if (!below_affected) targets.push_back(node_of_id[id]);
+  }
 
   std::set<Node*> filtered_nodes;
-  root->filter_nd_pcid(tpc, 0, filtered_nodes);
+  std::set<uint32_t> leaves_to_reindex;
+  for (auto& target : targets) {
+    size_t prefix_len_so_far = 0;
+    for (Node* node = target->parent; node != nullptr; node = node->parent)
+      if (node->get_prefix() != Node::EPSILON)
+        prefix_len_so_far += node->get_prefix().size();
+
+    target->filter_nd_pcid(tpc, prefix_len_so_far, filtered_nodes);
+    collect_leaves(target, leaves_to_reindex);
+  }
 
-  std::set<InternalNode*> may_need_sort;
+  std::set<uint32_t> may_need_sort;
   for (auto& filtered_node : filtered_nodes)
-    if (!filtered_node->is_root()) may_need_sort.insert(filtered_node->parent);
+    if (!filtered_node->is_root())
+      may_need_sort.insert(filtered_node->parent->id);
 
   assert(no_empty_prefixed_node());
 
@@ -1114,22 +1812,26 @@ void ExecTree::prune() {
   assert(no_empty_prefixed_node());
   assert(no_epsilon_internal_node());
 
-  std::set<InternalNode*> may_have_only_child;
+  std::set<uint32_t> may_have_only_child;
   while (true) {
     if (may_need_sort.empty()) break;
 
     auto it = may_need_sort.begin();
-    InternalNode* target = *it;
+    uint32_t target = *it;
     may_need_sort.erase(it);
 
-    if (!has(target)) continue;
+    if (!has_id(target)) continue;
 
-    std::set<Node*> merged_nodes = sort(target);
+    std::set<uint32_t> merged_nodes = sort(as_internal(node_of_id[target]));
     if (!merged_nodes.empty()) {
       may_have_only_child.insert(target);
-      for (auto& merged_node : merged_nodes)
-        if (has(merged_node) && merged_node->is_internal())
-          may_need_sort.insert(as_internal(merged_node));
+      for (auto& merged_node : merged_nodes) {
+        if (!has_id(merged_node)) continue;
+        if (node_of_id[merged_node]->is_internal())
+          may_need_sort.insert(merged_node);
+        else
+          leaves_to_reindex.insert(merged_node);
+      }
     }
   }
 
@@ -1138,17 +1840,29 @@ void ExecTree::prune() {
   assert(sorted());
 
   for (auto& internal : may_have_only_child)
-    if (has(internal)) rm_internal_with_only_child(internal);
+    if (has_id(internal))
+      rm_internal_with_only_child(as_internal(node_of_id[internal]));
 
   assert(no_empty_prefixed_node());
   assert(no_epsilon_internal_node());
   assert(sorted());
+
+  // Paths of leaves may have been changed by pruning.
+  for (auto& id : leaves_to_reindex) {
+    if (!has_id(id) || !node_of_id[id]->is_leaf()) continue;
+    LeafNode* leaf = as_leaf(node_of_id[id]);
+    unindex_path(leaf);
+    index_path(leaf, tpc->PathHash(leaf->get_path_log(true)));
+  }
+
+  compact_prefix_pool();
+  enforce_memory_budget();
 }
 
 bool ExecTree::no_empty_prefixed_node() const {
   for (auto& node : get_all_nodes()) {
     assert(has(node));
-    if (node->prefix.empty()) return false;
+    if (node->get_prefix().empty()) return false;
   }
 
   return true;
@@ -1156,7 +1870,8 @@ bool ExecTree::no_empty_prefixed_node() const {
 bool ExecTree::no_epsilon_internal_node() const {
   for (auto& internal : internals) {
     assert(has(internal));
-    if (internal->prefix == Node::EPSILON && !internal->is_root()) return false;
+    if (internal->get_prefix() == Node::EPSILON && !internal->is_root())
+      return false;
   }
 
   return true;
@@ -1185,12 +1900,16 @@ bool ExecTree::is_sorted() const {
 size_t ExecTree::total_prefix_length() const {
   size_t total_length = 0;
   for (auto& node : get_all_nodes())
-    if (node->prefix != Node::EPSILON) total_length += node->prefix.size();
+    if (node->get_prefix() != Node::EPSILON)
+      total_length += node->get_prefix().size();
   return total_length;
 }
 size_t ExecTree::num_total_input() const {
-  return all_input.size();
-  ;
+  return all_input.size() + spilled_input.size();
+}
+size_t ExecTree::resident_size() const { return resident_bytes; }
+size_t ExecTree::spilled_size() const {
+  return spill_file == nullptr ? 0 : spill_file->size() * sizeof(uint32_t);
 }
 std::string ExecTree::to_string(bool print_epath) const {
   if (is_empty()) {
@@ -0,0 +1,81 @@
+#include "fork_server.h"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "utils.h"
+
+namespace pathfinder {
+
+ForkServer::ForkServer(UserCallback callback_, TracePC* tpc_)
+    : callback(callback_), tpc(tpc_) {
+  void* mem = mmap(nullptr, sizeof(int), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  PATHFINDER_CHECK(mem != MAP_FAILED,
+                   "PathFinder Error: Failed to map shared memory");
+  run_status = (int*)mem;
+}
+ForkServer::~ForkServer() { munmap(run_status, sizeof(int)); }
+int ForkServer::run(const Input& input, unsigned timeout) {
+  if (!ready) {
+    ready = true;
+    return callback(input);
+  }
+
+  sigset_t sigchld_mask, old_mask;
+  sigemptyset(&sigchld_mask);
+  sigaddset(&sigchld_mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &sigchld_mask, &old_mask);
+
+  *run_status = PATHFINDER_CRASH;
+  std::cout << std::flush;
+  std::cerr << std::flush;
+  pid_t pid = fork();
+  PATHFINDER_CHECK(pid >= 0, "PathFinder Error: Failed to fork");
+  if (pid == 0) {
+    sigprocmask(SIG_SETMASK, &old_mask, nullptr);
+    *run_status = callback(input);
+    if (tpc != nullptr) tpc->TraceOff();
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    _exit(0);
+  }
+
+  int wstatus = -1;
+  bool timed_out = false;
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+  while (waitpid(pid, &wstatus, WNOHANG) == 0) {
+    if (timeout == 0) {
+      sigwaitinfo(&sigchld_mask, nullptr);
+      continue;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      kill(pid, SIGKILL);
+      waitpid(pid, &wstatus, 0);
+      timed_out = true;
+      break;
+    }
+    size_t remained =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now)
+            .count();
+    struct timespec timeout_;
+    timeout_.tv_sec = remained / 1000000000;
+    timeout_.tv_nsec = remained % 1000000000;
+    sigtimedwait(&sigchld_mask, nullptr, &timeout_);
+  }
+  sigprocmask(SIG_SETMASK, &old_mask, nullptr);
+
+  if (timed_out) return PATHFINDER_TIMEOUT;
+  if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)
+    return PATHFINDER_CRASH;
+  return *run_status;
+}
+
+}  // namespace pathfinder
@@ -12,8 +12,32 @@ void InputGenerator::set_condition(
   bool conform_soft = std::rand() % 2 == 0;
   enum_solver->set_condition(enum_conditions);
   numeric_solver->set_condition(numeric_conditions, conform_soft);
+  path = std::nullopt;
+  flipped_inputs.clear();
+}
+void InputGenerator::set_flips(std::vector<Flip> path_) {
+  bool conform_soft = std::rand() % 2 == 0;
+  numeric_solver->set_condition({}, conform_soft);
+  path = std::move(path_);
+  flipped_inputs.clear();
+  drew_flips = false;
 }
 std::optional<Input> InputGenerator::gen() {
+  if (path.has_value()) {
+    if (flipped_inputs.empty()) gen_flips();
+    // Inputs drawn are excluded from later batches, which may run out for
+    // that alone, so those start over once.
+    if (flipped_inputs.empty() && drew_flips) {
+      numeric_solver->clear_history();
+      gen_flips();
+    }
+    if (flipped_inputs.empty()) return std::nullopt;
+    drew_flips = true;
+    Input input = flipped_inputs.front();
+    flipped_inputs.pop_front();
+    return input;
+  }
+
   auto enum_args = enum_solver->draw();
   auto numeric_args = numeric_solver->draw();
 
@@ -21,5 +45,32 @@ std::optional<Input> InputGenerator::gen() {
 
   return Input(enum_args.value(), numeric_args.value());
 }
+bool InputGenerator::is_unsat() const {
+  return !path.has_value() || !drew_flips;
+}
+void InputGenerator::gen_flips() {
+  std::vector<std::optional<Args>> numeric_args =
+      numeric_solver->draw_flips(path.value());
+
+  // Enum conditions are solved apart, query by query, as their solver builds
+  // anew from its conditions anyway.
+  std::vector<EnumCondition*> enum_conditions;
+  for (size_t i = 0; i < path->size(); i++) {
+    const Flip& flip = path->at(i);
+    if (numeric_args[i].has_value()) {
+      std::vector<EnumCondition*> flipped_conditions = enum_conditions;
+      if (flip.sibling != nullptr && flip.sibling->get_condtype() == CT_ENUM)
+        flipped_conditions.push_back(
+            static_cast<EnumCondition*>(flip.sibling));
+      enum_solver->set_condition(flipped_conditions);
+      if (auto enum_args = enum_solver->draw())
+        // Deepest first, as those leave the path closest to its frontier.
+        flipped_inputs.push_front(
+            Input(enum_args.value(), numeric_args[i].value()));
+    }
+    if (flip.cond->get_condtype() == CT_ENUM)
+      enum_conditions.push_back(static_cast<EnumCondition*>(flip.cond));
+  }
+}
 
 }  // namespace pathfinder
@@ -58,18 +58,23 @@ void InputSignature::check_duplicate_and_register(std::string name) {
       name_set.find(name) == name_set.end(),
       "PathFinder Error: parameter name " + name + " is duplicated");
   name_set.insert(name);
+  param_names.push_back(name);
 }
 
 InputSignature input_signature;
 
-void register_enum_param(std::string name, std::vector<std::string> entries) {
+EnumArg register_enum_param(std::string name,
+                            std::vector<std::string> entries) {
   input_signature.push(EnumParam(name, entries));
+  return EnumArg{(uint32_t)input_signature.param_names.size() - 1};
 }
-void register_enum_param(std::string name, size_t start, size_t size) {
+EnumArg register_enum_param(std::string name, size_t start, size_t size) {
   input_signature.push(EnumParam(name, start, size));
+  return EnumArg{(uint32_t)input_signature.param_names.size() - 1};
 }
-void register_int_param(std::string name) {
+IntArg register_int_param(std::string name) {
   input_signature.push(NumericParam(name));
+  return IntArg{(uint32_t)input_signature.param_names.size() - 1};
 }
 const std::vector<EnumParam>& get_enum_params() {
   return input_signature.enum_params;
@@ -80,6 +85,9 @@ const std::vector<std::vector<EnumParam>>& get_enum_param_groups() {
 const std::vector<NumericParam>& get_numeric_params() {
   return input_signature.numeric_params;
 }
+const std::vector<std::string>& get_param_names() {
+  return input_signature.param_names;
+}
 std::vector<std::string> get_enum_param_names() {
   std::vector<std::string> enum_param_names;
   for (auto& enum_param : get_enum_params())
@@ -0,0 +1,152 @@
+#include "input_store.h"
+
+#include <cassert>
+
+#include "input_signature.h"
+
+namespace pathfinder {
+
+InputStore::InputStore() {
+  // The empty input is pinned, so that default constructed ones are free.
+  entries.push_back({Args(), Args(), {}, hash_values({}), 1});
+}
+uint32_t InputStore::intern(Args enum_args, Args numeric_args) {
+  if (enum_args.empty() && numeric_args.empty()) return EMPTY_ID;
+
+  std::vector<long> values;
+  for (auto& name : get_param_names()) {
+    auto it = enum_args.find(name);
+    if (it != enum_args.end()) {
+      values.push_back(it->second);
+    } else {
+      it = numeric_args.find(name);
+      values.push_back(it != numeric_args.end() ? it->second : 0);
+    }
+  }
+  uint64_t hash = hash_values(values);
+  auto range = id_of_hash.equal_range(hash);
+  for (auto it = range.first; it != range.second; it++) {
+    Entry& entry = entries[it->second];
+    if (entry.enum_args == enum_args && entry.numeric_args == numeric_args) {
+      entry.refcount++;
+      return it->second;
+    }
+  }
+
+  uint32_t id;
+  if (free_ids.empty()) {
+    id = entries.size();
+    entries.push_back(Entry());
+  } else {
+    id = free_ids.back();
+    free_ids.pop_back();
+  }
+  entries[id] = {std::move(enum_args), std::move(numeric_args),
+                 std::move(values), hash, 1};
+  id_of_hash.insert({hash, id});
+  return id;
+}
+void InputStore::retain(uint32_t id) {
+  if (id == EMPTY_ID) return;
+  assert(entries[id].refcount > 0);
+  entries[id].refcount++;
+}
+void InputStore::release(uint32_t id) {
+  if (id == EMPTY_ID) return;
+  Entry& entry = entries[id];
+  assert(entry.refcount > 0);
+  if (--entry.refcount > 0) return;
+
+  auto range = id_of_hash.equal_range(entry.hash);
+  for (auto it = range.first; it != range.second; it++) {
+    if (it->second == id) {
+      id_of_hash.erase(it);
+      break;
+    }
+  }
+  entry.enum_args.clear();
+  entry.numeric_args.clear();
+  std::vector<long>().swap(entry.values);
+  free_ids.push_back(id);
+}
+const Args& InputStore::get_enum_args(uint32_t id) const {
+  return entries[id].enum_args;
+}
+const Args& InputStore::get_numeric_args(uint32_t id) const {
+  return entries[id].numeric_args;
+}
+const long* InputStore::get_values(uint32_t id) const {
+  return entries[id].values.data();
+}
+uint64_t InputStore::get_hash(uint32_t id) const { return entries[id].hash; }
+size_t InputStore::size() const { return entries.size() - free_ids.size(); }
+static uint64_t splitmix64(uint64_t value) {
+  value += 0x9e3779b97f4a7c15;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+uint64_t InputStore::hash_values(const std::vector<long>& values) {
+  // Arguments are mostly small integers, so each is mixed on its own, along
+  // with its parameter id, before being folded in.
+  uint64_t hash = 0;
+  for (size_t i = 0; i < values.size(); i++)
+    hash = splitmix64(hash ^ splitmix64((uint64_t)values[i]) ^ i);
+  return hash;
+}
+
+InputStore& input_store() {
+  // Leaked on purpose, as inputs in static storage may outlive it otherwise.
+  static InputStore* store = new InputStore();
+  return *store;
+}
+
+Input::Input() { set_id(InputStore::EMPTY_ID); }
+Input::Input(Args enum_args_, Args numeric_args_) {
+  set_id(
+      input_store().intern(std::move(enum_args_), std::move(numeric_args_)));
+}
+Input::Input(const Input& other) : id(other.id), values(other.values) {
+  input_store().retain(id);
+}
+Input::Input(Input&& other) : id(other.id), values(other.values) {
+  other.set_id(InputStore::EMPTY_ID);
+}
+Input& Input::operator=(const Input& other) {
+  input_store().retain(other.id);
+  input_store().release(id);
+  id = other.id;
+  values = other.values;
+  return *this;
+}
+Input& Input::operator=(Input&& other) {
+  if (this != &other) {
+    input_store().release(id);
+    id = other.id;
+    values = other.values;
+    other.set_id(InputStore::EMPTY_ID);
+  }
+  return *this;
+}
+Input::~Input() { input_store().release(id); }
+const Args& Input::get_enum_args() const {
+  return input_store().get_enum_args(id);
+}
+const Args& Input::get_numeric_args() const {
+  return input_store().get_numeric_args(id);
+}
+uint64_t Input::get_hash() const { return input_store().get_hash(id); }
+long Input::operator[](const std::string& key) const {
+  const Args& enum_args = get_enum_args();
+  auto it = enum_args.find(key);
+  if (it != enum_args.end())
+    return it->second;
+  else
+    return get_numeric_args().at(key);
+}
+void Input::set_id(uint32_t id_) {
+  id = id_;
+  values = input_store().get_values(id);
+}
+
+}  // namespace pathfinder
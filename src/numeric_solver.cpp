@@ -70,13 +70,15 @@ std::unique_ptr<z3::expr> Solver::current_assignment() {
     current_assignments.push_back(solver_var->current());
   return conjunction(current_assignments);
 }
-std::optional<Args> Solver::draw() {
+std::optional<Args> Solver::draw(const std::vector<z3::expr>& assumptions) {
   std::optional<Args> args_opt;
 
   s->push();
   if (history != nullptr) s->add(*history);
 
-  if (s->check() != z3::sat) {
+  z3::expr_vector assumptions_(*ctx);
+  for (auto& assumption : assumptions) assumptions_.push_back(assumption);
+  if (s->check(assumptions_) != z3::sat) {
     args_opt = std::nullopt;
   } else {
     assign(s->get_model());
@@ -99,6 +101,10 @@ Args Solver::get_args() {
   return args;
 }
 
+const size_t NumericSolver::MAX_GUARDS = 4096;
+
+bool Flip::is_query() const { return negate || sibling != nullptr; }
+
 NumericSolver::NumericSolver() : Solver() {
   std::vector<z3::expr> basic_ctrs;
   for (auto param : get_numeric_params()) {
@@ -117,32 +123,47 @@ NumericSolver::NumericSolver() : Solver() {
   for (auto& soft_ctr : soft_constraints)
     soft_ctrs.push_back(soft_ctr->to_z3_expr(*get_ctx()));
   soft_constraint = conjunction(soft_ctrs);
+  if (soft_constraint != nullptr)
+    soft_guard =
+        std::make_unique<z3::expr>(get_ctx()->bool_const("__guard_soft"));
+
+  reset();
 }
-void NumericSolver::reset(bool conform_soft) {
+void NumericSolver::reset() {
   Solver::reset();
-
-  bool violating = std::rand() % 2 == 0;
+  guards.clear();
 
   if (basic_constraint != nullptr) get_solver()->add(*basic_constraint);
   if (hard_constraint != nullptr) get_solver()->add(*hard_constraint);
-  if (soft_constraint != nullptr) {
-    if (conform_soft)
-      get_solver()->add(*soft_constraint);
-    else
-      get_solver()->add(!(*soft_constraint));
-  }
+  if (soft_constraint != nullptr)
+    get_solver()->add(*soft_guard == *soft_constraint);
+}
+std::optional<z3::expr> NumericSolver::guard(BranchCondition* cond) {
+  if (cond == nullptr || cond->get_condtype() != CT_NUMERIC || cond->invalid())
+    return std::nullopt;
+
+  auto it = guards.find(cond->get_serial());
+  if (it != guards.end()) return it->second;
+
+  z3::expr literal = get_ctx()->bool_const(
+      ("__guard_" + std::to_string(cond->get_serial())).c_str());
+  get_solver()->add(
+      literal ==
+      static_cast<NumericCondition*>(cond)->cond->to_z3_expr(*get_ctx()));
+  guards.insert({cond->get_serial(), literal});
+  return literal;
 }
 void NumericSolver::set_condition(
     std::vector<NumericCondition*> numeric_conditions, bool conform_soft) {
-  reset(conform_soft);
+  if (guards.size() + numeric_conditions.size() > MAX_GUARDS) reset();
+  clear_history();
 
-  std::unique_ptr<BoolExpr> numeric_cond =
-      std::make_unique<BoolExpr>(BoolExpr::true_expr());
+  assumptions.clear();
+  if (soft_guard != nullptr)
+    assumptions.push_back(conform_soft ? *soft_guard : !*soft_guard);
   for (auto& numeric_condition : numeric_conditions)
-    if (!numeric_condition->invalid())
-      numeric_cond = std::make_unique<BoolExpr>(*numeric_cond &&
-                                                *(numeric_condition->cond));
-  get_solver()->add(numeric_cond->to_z3_expr(*get_ctx()));
+    if (auto literal = guard(numeric_condition))
+      assumptions.push_back(literal.value());
 }
 z3::expr NumericSolver::rand_constraint() {
   int num_args = solver_vars.size();
@@ -179,20 +200,42 @@ std::optional<Args> NumericSolver::draw() {
   if (rand_float() < MUT_RATE && solver_vars.size() > 1) {
     get_solver()->push();
     get_solver()->add(rand_constraint());
-    args_opt = Solver::draw();
+    args_opt = Solver::draw(assumptions);
     get_solver()->pop();
 
     if (args_opt.has_value()) return args_opt.value();
   }
 
-  args_opt = Solver::draw();
+  args_opt = Solver::draw(assumptions);
 
   if (!args_opt.has_value()) {
     clear_history();
-    args_opt = Solver::draw();
+    args_opt = Solver::draw(assumptions);
   }
 
   return args_opt;
 }
+std::vector<std::optional<Args>> NumericSolver::draw_flips(
+    const std::vector<Flip>& path) {
+  // Queries only differ in their assumptions: the guards of the conditions
+  // above their node, and the flipped one.
+  std::vector<z3::expr> path_assumptions = assumptions;
+  std::vector<std::optional<Args>> args(path.size());
+  for (size_t i = 0; i < path.size(); i++) {
+    const Flip& flip = path[i];
+    std::optional<z3::expr> literal = guard(flip.cond);
+    if (flip.is_query()) {
+      std::vector<z3::expr> query_assumptions = path_assumptions;
+      if (flip.negate) {
+        query_assumptions.push_back(!literal.value());
+      } else if (auto sibling_literal = guard(flip.sibling)) {
+        query_assumptions.push_back(sibling_literal.value());
+      }
+      args[i] = Solver::draw(query_assumptions);
+    }
+    if (literal.has_value()) path_assumptions.push_back(literal.value());
+  }
+  return args;
+}
 
 }  // namespace pathfinder
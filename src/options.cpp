@@ -20,6 +20,9 @@ enum PATHFINDER_OPTION {
   OPT_OUTPUT_UNIQUE,
   OPT_OUTPUT_COV,
   OPT_OUTPUT_STAT,
+  OPT_SNAPSHOT,
+  OPT_SNAPSHOT_INTERVAL,
+  OPT_RESUME,
   OPT_COLORIZE_OUTPUT,
 
   OPT_RUN_ONLY,
@@ -32,11 +35,18 @@ enum PATHFINDER_OPTION {
   OPT_IGNORE_EXCEPTION,
 
   OPT_SCHEDULE,
+  OPT_SEARCH,
   OPT_INT_MIN,
   OPT_INT_MAX,
   OPT_MUT_RATE,
   OPT_COND_ACCURACY_THRESHOLD,
   OPT_WO_NBP,
+  OPT_DIFF,
+  OPT_ND_VOTE_RUNS,
+  OPT_THREAD_POLICY,
+  OPT_PC_ALLOWLIST,
+  OPT_PC_DENYLIST,
+  OPT_CMP_LITERALS,
   OPT_MAX_TOTAL_TIME,
   OPT_MAX_TOTAL_GEN,
   OPT_COV_INTERVAL_TIME,
@@ -47,6 +57,10 @@ enum PATHFINDER_OPTION {
   OPT_MAX_GEN_PER_ITER,
   OPT_MAX_TIME_PER_ITER,
   OPT_CALLBACK_TIMEOUT,
+  OPT_FORK_SERVER,
+  OPT_COMPRESS_LOOPS,
+  OPT_LOOP_BUCKETS,
+  OPT_MEMORY_BUDGET,
 
   OPT_HELP,
 };
@@ -59,6 +73,9 @@ option longopts[] = {
     {"output_unique", no_argument, NULL, OPT_OUTPUT_UNIQUE},
     {"output_cov", required_argument, NULL, OPT_OUTPUT_COV},
     {"output_stat", required_argument, NULL, OPT_OUTPUT_STAT},
+    {"snapshot", required_argument, NULL, OPT_SNAPSHOT},
+    {"snapshot_interval", required_argument, NULL, OPT_SNAPSHOT_INTERVAL},
+    {"resume", required_argument, NULL, OPT_RESUME},
     {"colorize", required_argument, NULL, OPT_COLORIZE_OUTPUT},
 
     {"run_only", no_argument, NULL, OPT_RUN_ONLY},
@@ -71,12 +88,19 @@ option longopts[] = {
     {"ignore_exception", no_argument, NULL, OPT_IGNORE_EXCEPTION},
 
     {"schedule", required_argument, NULL, OPT_SCHEDULE},
+    {"search", required_argument, NULL, OPT_SEARCH},
     {"min", required_argument, NULL, OPT_INT_MIN},
     {"max", required_argument, NULL, OPT_INT_MAX},
     {"mut_rate", required_argument, NULL, OPT_MUT_RATE},
     {"cond_accuracy_threshold", required_argument, NULL,
      OPT_COND_ACCURACY_THRESHOLD},
     {"wo_nbp", no_argument, NULL, OPT_WO_NBP},
+    {"diff", required_argument, NULL, OPT_DIFF},
+    {"nd_vote_runs", required_argument, NULL, OPT_ND_VOTE_RUNS},
+    {"thread_policy", required_argument, NULL, OPT_THREAD_POLICY},
+    {"pc_allowlist", required_argument, NULL, OPT_PC_ALLOWLIST},
+    {"pc_denylist", required_argument, NULL, OPT_PC_DENYLIST},
+    {"cmp_literals", required_argument, NULL, OPT_CMP_LITERALS},
     {"max_total_time", required_argument, NULL, OPT_MAX_TOTAL_TIME},
     {"max_total_gen", required_argument, NULL, OPT_MAX_TOTAL_GEN},
     {"cov_interval_time", required_argument, NULL, OPT_COV_INTERVAL_TIME},
@@ -87,6 +111,10 @@ option longopts[] = {
     {"max_gen_per_iter", required_argument, NULL, OPT_MAX_GEN_PER_ITER},
     {"max_time_per_iter", required_argument, NULL, OPT_MAX_TIME_PER_ITER},
     {"callback_timeout", required_argument, NULL, OPT_CALLBACK_TIMEOUT},
+    {"fork_server", no_argument, NULL, OPT_FORK_SERVER},
+    {"compress_loops", required_argument, NULL, OPT_COMPRESS_LOOPS},
+    {"loop_buckets", required_argument, NULL, OPT_LOOP_BUCKETS},
+    {"memory_budget", required_argument, NULL, OPT_MEMORY_BUDGET},
 
     {"help", no_argument, NULL, OPT_HELP},
     {0}};
@@ -98,6 +126,9 @@ fs::path CORPUS;
 bool OUTPUT_UNIQUE = true;
 std::string COV_OUTPUT_FILENAME = "";
 std::string STAT_OUTPUT_FILENAME = "";
+std::string SNAPSHOT_FILENAME = "";
+size_t SNAPSHOT_INTERVAL = 600;
+std::string RESUME_FILENAME = "";
 bool COLORIZE_OUTPUT = true;
 
 bool RUN_ONLY = false;
@@ -110,6 +141,7 @@ std::string CMD_LINE_CONSTRAINT;
 bool IGNORE_EXCEPTION = false;
 
 SCHEDULE SCHEDULING_STRATEGY = SCHEDULE_RAND;
+SEARCH SEARCH_STRATEGY = SEARCH_PATH;
 int ARG_INT_MIN = -64;
 int ARG_INT_MAX = 64;
 int MAX_GEN_PER_ITER = 10;
@@ -117,9 +149,19 @@ size_t MAX_TIME_PER_ITER = 10000;  // max time per iteration in milliseconds.
 float MUT_RATE = 0.2f;
 float COND_ACCURACY_THRESHOLD = 0.6f;
 bool WO_NBP = false;
+DIFF_ALGORITHM DIFF = DIFF_MYERS;
+size_t ND_VOTE_RUNS = 64;
+THREAD_POLICY TRACE_THREAD_POLICY = THREAD_SHARED;
+std::string PC_ALLOWLIST = "";
+std::string PC_DENYLIST = "";
+size_t CMP_LITERALS = 0;
 
 int MAX_ITER = INT_MAX;
 unsigned CALLBACK_TIMEOUT = 1;
+bool FORK_SERVER = false;
+size_t LOOP_MAX_PERIOD = 0;
+std::vector<size_t> LOOP_BUCKETS = {1, 2, 3, 4, 8, 16, 32, 128};
+size_t MEMORY_BUDGET = 0;
 size_t MAX_TOTAL_TIME = INT_MAX;
 size_t MAX_TOTAL_GEN = INT_MAX;
 size_t COV_INTERVAL_TIME = 0;
@@ -140,6 +182,14 @@ void print_usage(int exit_code, char* program_name) {
       "name.\n"
       "    --output_stat               Output statistic summary(csv) to given "
       "file name.\n"
+      "    --snapshot                  Periodically save the path tree to "
+      "given file name, and on exit.\n"
+      "    --snapshot_interval         Interval of saving snapshots in "
+      "seconds. (default=600)\n"
+      "    --resume                    Resume from given snapshot instead of "
+      "running corpus and warming up.\n"
+      "                                Statistics of the scheduler are not "
+      "saved, and start over.\n"
       "    --colorize                  Colorize output. (default=1)\n\n"
 
       "    --run_only                  Run inputs in corpus and exit. Useful "
@@ -168,7 +218,17 @@ void print_usage(int exit_code, char* program_name) {
       "Useful when measure coverage.\n\n"
 
       "    --schedule                  Set scheduling strategy. Should be one "
-      "of {random}. (default=random)\n"
+      "of {rand, rarity, ucb, cost}. (default=rand)\n"
+      "                                `rarity` favors paths rarely run by "
+      "generated inputs, `ucb` paths that led\n"
+      "                                to new paths or counterexamples, and "
+      "`cost` does as `ucb` per second spent\n"
+      "                                running them.\n"
+      "    --search                    Set search strategy. Should be one of "
+      "{path, generational}. (default=path)\n"
+      "                                `path` aims at the scheduled path, and "
+      "`generational` at leaving it at each of\n"
+      "                                its branches in turn.\n"
       "    --min                       Minimum integer value of variables in "
       "synthesized function for searching CEs. (default=-64)\n"
       "    --max                       Maximum integer value of variables in "
@@ -178,7 +238,30 @@ void print_usage(int exit_code, char* program_name) {
       "    --cond_accuracy_threshold   If accuracy of a barnch condition is "
       "lower than this, try refinement. (default=0.6)\n"
       "    --wo_nbp                    Disable nondeterministic branch "
-      "pruning.\n\n"
+      "pruning.\n"
+      "    --diff                      Diff algorithm used for finding "
+      "nondeterministic branches. Should be one of {myers,patience}. "
+      "(default=myers)\n"
+      "    --nd_vote_runs              Number of runs of the same input for "
+      "finding nondeterministic branches in warmup. (default=64)\n"
+      "    --thread_policy             How PCs of threads other than the one "
+      "running target function are traced. Should be one of\n"
+      "                                {shared,main,concat,merge}. shared: "
+      "into the same path, main: ignored, concat: appended\n"
+      "                                per thread in order of their first "
+      "PC, merge: appended as a sorted set. (default=shared)\n"
+      "    --pc_allowlist              File of function or module names, one "
+      "per line. Trace only PCs in functions or modules\n"
+      "                                whose name contains one of them. "
+      "Requires `-fsanitize-coverage=pc-table`.\n"
+      "    --pc_denylist               File of function or module names, one "
+      "per line. Do not trace PCs in functions or modules\n"
+      "                                whose name contains one of them. "
+      "Requires `-fsanitize-coverage=pc-table`.\n"
+      "    --cmp_literals              Add given number of most frequent "
+      "constants compared in target function to literals\n"
+      "                                of synthesized conditions. Requires "
+      "`-fsanitize-coverage=trace-cmp`. (default=0)\n\n"
 
       "    --iter                      Max number of refining iteration. "
       "(default=INT_MAX).\n"
@@ -189,7 +272,21 @@ void print_usage(int exit_code, char* program_name) {
       "    --max_time_per_iter         Max time per iteration of target branch "
       "in milliseconds.\n"
       "    --callback_timeout          Timeout of each execution of target "
-      "function in seconds. (default=1)\n"
+      "function in seconds. Enforced in fork server mode only. (default=1)\n"
+      "    --fork_server               Run each execution of target function "
+      "in a forked child process.\n"
+      "                                Crashing or hanging inputs are kept in "
+      "corpus instead of terminating the fuzzer.\n"
+      "    --compress_loops            Compress repeated loop bodies of at "
+      "most given length in execution paths. (default=0, disabled)\n"
+      "    --loop_buckets              Iteration counts of a compressed loop "
+      "that are recorded in execution paths.\n"
+      "                                Should be quoted and comma "
+      "separated. (default=\"1,2,3,4,8,16,32,128\")\n"
+      "    --memory_budget             Memory budget in MB for inputs and "
+      "tails of paths. Least recently used ones are\n"
+      "                                spilled to a temporary file over it. "
+      "(default=0, unlimited)\n"
       "    --max_total_time            Maximum total time in seconds.\n"
       "    --max_total_gen             Maximum total input generation.\n"
       "    --cov_interval_time         Time interval for checking coverage.\n"
@@ -214,9 +311,31 @@ void parse_arg(int argc, char** argv) {
         if (strcmp(optarg, "rand") == 0) {
           SCHEDULING_STRATEGY = SCHEDULE_RAND;
           break;
+        } else if (strcmp(optarg, "rarity") == 0) {
+          SCHEDULING_STRATEGY = SCHEDULE_RARITY;
+          break;
+        } else if (strcmp(optarg, "ucb") == 0) {
+          SCHEDULING_STRATEGY = SCHEDULE_UCB;
+          break;
+        } else if (strcmp(optarg, "cost") == 0) {
+          SCHEDULING_STRATEGY = SCHEDULE_COST;
+          break;
         } else {
           std::cout << "PathFinder Error: Invalid scheduling option `" << optarg
-                    << "`. Available scheduling options: {rand}.\n";
+                    << "`. Available scheduling options: {rand, rarity, "
+                       "ucb, cost}.\n";
+          exit(0);
+        }
+      case OPT_SEARCH:
+        if (strcmp(optarg, "path") == 0) {
+          SEARCH_STRATEGY = SEARCH_PATH;
+          break;
+        } else if (strcmp(optarg, "generational") == 0) {
+          SEARCH_STRATEGY = SEARCH_GENERATIONAL;
+          break;
+        } else {
+          std::cout << "PathFinder Error: Invalid search option `" << optarg
+                    << "`. Available search options: {path, generational}.\n";
           exit(0);
         }
       case OPT_INT_MIN:
@@ -234,6 +353,18 @@ void parse_arg(int argc, char** argv) {
       case OPT_WO_NBP:
         WO_NBP = true;
         break;
+      case OPT_DIFF:
+        if (strcmp(optarg, "myers") == 0) {
+          DIFF = DIFF_MYERS;
+          break;
+        } else if (strcmp(optarg, "patience") == 0) {
+          DIFF = DIFF_PATIENCE;
+          break;
+        } else {
+          std::cout << "PathFinder Error: Invalid diff option `" << optarg
+                    << "`. Available diff options: {myers,patience}.\n";
+          exit(0);
+        }
       case OPT_CORPUS:
         CORPUS = fs::path(optarg);
         break;
@@ -246,6 +377,15 @@ void parse_arg(int argc, char** argv) {
       case OPT_OUTPUT_STAT:
         STAT_OUTPUT_FILENAME = optarg;
         break;
+      case OPT_SNAPSHOT:
+        SNAPSHOT_FILENAME = optarg;
+        break;
+      case OPT_SNAPSHOT_INTERVAL:
+        SNAPSHOT_INTERVAL = (size_t)atoi(optarg);
+        break;
+      case OPT_RESUME:
+        RESUME_FILENAME = optarg;
+        break;
       case OPT_COLORIZE_OUTPUT:
         COLORIZE_OUTPUT = bool(optarg);
         break;
@@ -288,6 +428,48 @@ void parse_arg(int argc, char** argv) {
       case OPT_CALLBACK_TIMEOUT:
         CALLBACK_TIMEOUT = (size_t)atoi(optarg);
         break;
+      case OPT_FORK_SERVER:
+        FORK_SERVER = true;
+        break;
+      case OPT_COMPRESS_LOOPS:
+        LOOP_MAX_PERIOD = (size_t)atoi(optarg);
+        break;
+      case OPT_LOOP_BUCKETS:
+        LOOP_BUCKETS.clear();
+        for (auto bucket : split_all(optarg, ','))
+          LOOP_BUCKETS.push_back((size_t)atoi(strip(bucket).c_str()));
+        break;
+      case OPT_MEMORY_BUDGET:
+        MEMORY_BUDGET = (size_t)atoi(optarg);
+        break;
+      case OPT_ND_VOTE_RUNS:
+        ND_VOTE_RUNS = (size_t)atoi(optarg);
+        break;
+      case OPT_THREAD_POLICY:
+        if (strcmp(optarg, "shared") == 0) {
+          TRACE_THREAD_POLICY = THREAD_SHARED;
+        } else if (strcmp(optarg, "main") == 0) {
+          TRACE_THREAD_POLICY = THREAD_MAIN;
+        } else if (strcmp(optarg, "concat") == 0) {
+          TRACE_THREAD_POLICY = THREAD_CONCAT;
+        } else if (strcmp(optarg, "merge") == 0) {
+          TRACE_THREAD_POLICY = THREAD_MERGE;
+        } else {
+          std::cout << "PathFinder Error: Invalid thread policy option `"
+                    << optarg << "`. Available thread policy options: "
+                    << "{shared,main,concat,merge}.\n";
+          exit(0);
+        }
+        break;
+      case OPT_PC_ALLOWLIST:
+        PC_ALLOWLIST = optarg;
+        break;
+      case OPT_PC_DENYLIST:
+        PC_DENYLIST = optarg;
+        break;
+      case OPT_CMP_LITERALS:
+        CMP_LITERALS = (size_t)atoi(optarg);
+        break;
       case OPT_MAX_TOTAL_TIME:
         MAX_TOTAL_TIME = (size_t)atoi(optarg);
         break;
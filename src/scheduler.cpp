@@ -0,0 +1,230 @@
+#include "scheduler.h"
+
+#include <cmath>
+
+#include "options.h"
+
+namespace pathfinder {
+
+void WeightTree::resize(size_t size) {
+  // Positions are only appended, with no weight yet.
+  assert(size >= weights.size());
+  while (weights.size() < size) {
+    weights.push_back(0);
+    size_t i = weights.size();
+    tree.push_back(prefix(i - 1) - prefix(i - (i & -i)));
+  }
+}
+void WeightTree::set(size_t idx, double weight) {
+  assert(idx < weights.size());
+  double delta = weight - weights[idx];
+  weights[idx] = weight;
+  for (size_t i = idx + 1; i < tree.size(); i += i & -i) tree[i] += delta;
+}
+double WeightTree::get(size_t idx) const { return weights[idx]; }
+double WeightTree::total() const { return prefix(weights.size()); }
+size_t WeightTree::find(double value) const {
+  // The first position whose prefix sum exceeds `value`.
+  size_t pos = 0;
+  size_t step = 1;
+  while (step * 2 <= weights.size()) step *= 2;
+  for (; step > 0; step /= 2) {
+    if (pos + step <= weights.size() && tree[pos + step] <= value) {
+      pos += step;
+      value -= tree[pos];
+    }
+  }
+  return std::min(pos, weights.size() - 1);
+}
+size_t WeightTree::size() const { return weights.size(); }
+double WeightTree::prefix(size_t size) const {
+  double sum = 0;
+  for (size_t i = size; i > 0; i -= i & -i) sum += tree[i];
+  return sum;
+}
+
+Scheduler::Scheduler(ExecTree* exectree_) : exectree(exectree_) {}
+LeafNode* Scheduler::schedule() {
+  assert(!exectree->is_empty());
+
+  if (SCHEDULING_STRATEGY != SCHEDULE_RAND &&
+      num_selected >= 2 * num_selected_at_rebuild + 64)
+    rebuild();
+  else
+    sync_leaves();
+
+  // Leaves in quarantine are passed over, but only a few times, as there may
+  // be nothing else to pick.
+  static const size_t MAX_ATTEMPT = 8;
+  LeafNode* leaf = nullptr;
+  for (size_t i = 0; i < MAX_ATTEMPT; i++) {
+    leaf = pick();
+    if (!is_quarantined(leaf)) break;
+  }
+
+  uint32_t id = leaf->get_id();
+  last_scheduled = id;
+  num_selected++;
+  stats[id].num_selected++;
+  update(id);
+  return leaf;
+}
+LeafNode* Scheduler::pick() {
+  if (SCHEDULING_STRATEGY == SCHEDULE_RAND)
+    return random_choice(exectree->get_leaves());
+
+  // Weights of removed leaves are only dropped once sampled, and rounding
+  // errors build up, both of which rebuilding clears.
+  LeafNode* leaf = sample();
+  if (leaf == nullptr) {
+    rebuild();
+    leaf = sample();
+  }
+  if (leaf == nullptr) leaf = random_choice(exectree->get_leaves());
+  return leaf;
+}
+LeafNode* Scheduler::sample() {
+  static const size_t MAX_ATTEMPT = 16;
+  for (size_t i = 0; i < MAX_ATTEMPT; i++) {
+    double total = weights.total();
+    if (total <= 0) return nullptr;
+
+    double value = total * std::rand() / ((double)RAND_MAX + 1);
+    uint32_t id = weights.find(value);
+    if (weights.get(id) > 0 && exectree->has_id(id) &&
+        exectree->node_of_id[id]->is_leaf())
+      return as_leaf(exectree->node_of_id[id]);
+    weights.set(id, 0);
+  }
+  return nullptr;
+}
+void Scheduler::report_hit(LeafNode* leaf) {
+  uint32_t id = leaf->get_id();
+  if (id >= stats.size()) return;
+  stats[id].num_hits++;
+  update(id);
+}
+void Scheduler::report_new_path() {
+  if (!last_scheduled.has_value() || *last_scheduled >= stats.size()) return;
+  stats[*last_scheduled].num_new_paths++;
+  update(*last_scheduled);
+}
+void Scheduler::report_counterexample() {
+  if (!last_scheduled.has_value() || *last_scheduled >= stats.size()) return;
+  stats[*last_scheduled].num_counterexamples++;
+  update(*last_scheduled);
+}
+void Scheduler::report_failure() {
+  if (!last_scheduled.has_value() || *last_scheduled >= stats.size()) return;
+  uint32_t id = *last_scheduled;
+  if (!exectree->has_id(id)) return;
+
+  static const size_t MAX_BACKOFF = 16;
+  LeafStats& leaf_stats = stats[id];
+  uint64_t fingerprint_ = fingerprint(as_leaf(exectree->node_of_id[id]));
+  if (fingerprint_ != leaf_stats.failed_fingerprint)
+    leaf_stats.num_backoffs = 0;
+  leaf_stats.num_failures++;
+  leaf_stats.failed_fingerprint = fingerprint_;
+  leaf_stats.quarantined_until =
+      num_selected +
+      ((size_t)1 << std::min(leaf_stats.num_backoffs, MAX_BACKOFF));
+  leaf_stats.num_backoffs++;
+  update(id);
+}
+void Scheduler::report_run(LeafNode* leaf, size_t latency,
+                           size_t path_length) {
+  leaf->record_run(latency, path_length);
+  total_latency += latency;
+  num_runs++;
+  update(leaf->get_id());
+}
+bool Scheduler::is_quarantined(LeafNode* leaf) {
+  LeafStats& leaf_stats = stats[leaf->get_id()];
+  if (leaf_stats.num_backoffs == 0) return false;
+
+  // Released once a condition on its path is synthesized anew.
+  if (fingerprint(leaf) != leaf_stats.failed_fingerprint) {
+    leaf_stats.num_backoffs = 0;
+    leaf_stats.quarantined_until = 0;
+    return false;
+  }
+  return num_selected < leaf_stats.quarantined_until;
+}
+uint64_t Scheduler::fingerprint(LeafNode* leaf) const {
+  std::vector<EnumCondition*> enum_conds;
+  std::vector<NumericCondition*> numeric_conds;
+  std::tie(enum_conds, numeric_conds) = leaf->get_path_cond();
+
+  uint64_t hash = 0xcbf29ce484222325;
+  auto combine = [&hash](uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+  };
+  for (auto& cond : enum_conds) combine(cond->get_serial());
+  combine(enum_conds.size());
+  for (auto& cond : numeric_conds) combine(cond->get_serial());
+  return hash;
+}
+void Scheduler::sync_leaves() {
+  // Node ids are never reused, so leaves added since are at the end.
+  size_t num_ids = exectree->node_of_id.size();
+  if (num_ids == stats.size()) return;
+
+  size_t old_size = stats.size();
+  stats.resize(num_ids);
+  if (SCHEDULING_STRATEGY == SCHEDULE_RAND) return;
+
+  weights.resize(num_ids);
+  for (size_t id = old_size; id < num_ids; id++)
+    if (exectree->has_id(id) && exectree->node_of_id[id]->is_leaf())
+      weights.set(id, weight(id));
+}
+void Scheduler::rebuild() {
+  stats.resize(exectree->node_of_id.size());
+  weights = WeightTree();
+  weights.resize(stats.size());
+  num_selected_at_rebuild = num_selected;
+  for (auto& leaf : exectree->get_leaves())
+    weights.set(leaf->get_id(), weight(leaf->get_id()));
+}
+double Scheduler::weight(uint32_t id) const {
+  const LeafStats& leaf_stats = stats[id];
+  // Leaves whose conditions failed to give inputs are tried less and less.
+  double penalty = 1.0 / (1 + leaf_stats.num_failures);
+
+  if (SCHEDULING_STRATEGY == SCHEDULE_RARITY) {
+    // Paths that generated inputs rarely run are the ones worth aiming at.
+    return penalty / (1 + leaf_stats.num_hits);
+  }
+
+  // UCB1 over the rate of new paths and counterexamples per selection.
+  // The exploration term uses the number of selections at the last rebuild,
+  // so that it does not change every weight at every selection.
+  double num_tried = 1 + leaf_stats.num_selected;
+  double reward =
+      (leaf_stats.num_new_paths + leaf_stats.num_counterexamples) / num_tried;
+  double exploration =
+      std::sqrt(2 * std::log(2 + num_selected_at_rebuild) / num_tried);
+  if (SCHEDULING_STRATEGY == SCHEDULE_UCB)
+    return penalty * (reward + exploration);
+
+  assert(SCHEDULING_STRATEGY == SCHEDULE_COST);
+  // The same, per second its inputs take to run, so that cheap paths are
+  // explored first under a time budget. Leaves not run yet are assumed to
+  // take as long as the average run.
+  if (!exectree->has_id(id) || !exectree->node_of_id[id]->is_leaf()) return 0;
+  LeafNode* leaf = as_leaf(exectree->node_of_id[id]);
+  double latency = leaf->get_num_runs() > 0 ? leaf->get_latency()
+                   : num_runs > 0           ? (double)total_latency / num_runs
+                                            : 1e9;
+  // At least a microsecond, so that timer noise does not dominate.
+  double seconds = std::max(latency, 1e3) / 1e9;
+  return penalty * (reward + exploration) / seconds;
+}
+void Scheduler::update(uint32_t id) {
+  if (SCHEDULING_STRATEGY == SCHEDULE_RAND) return;
+  if (id >= weights.size() || weights.get(id) == 0) return;
+  weights.set(id, weight(id));
+}
+
+}  // namespace pathfinder
@@ -0,0 +1,293 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <type_traits>
+
+#include "input_signature.h"
+#include "sygus_parser.h"
+
+namespace pathfinder {
+
+const uint32_t Snapshot::VERSION = 2;
+static const uint64_t SNAPSHOT_MAGIC = 0x485350414e534650;  // "PFSNAPSH"
+
+class Snapshot::Writer {
+ public:
+  template <typename T>
+  void put(T value) {
+    static_assert(std::is_trivially_copyable<T>::value);
+    buffer.append((const char*)&value, sizeof(T));
+  }
+  void put_epath(ExecPathView epath) {
+    put<uint32_t>(epath.size());
+    buffer.append((const char*)epath.data(), epath.size() * sizeof(PCID));
+  }
+  void put_string(const std::string& str) {
+    put<uint32_t>(str.size());
+    buffer.append(str);
+  }
+
+  std::string buffer;
+};
+
+class Snapshot::Reader {
+ public:
+  Reader(const std::string& filename_, const uint8_t* data, size_t size)
+      : filename(filename_), cursor(data), end(data + size) {}
+  template <typename T>
+  T get() {
+    static_assert(std::is_trivially_copyable<T>::value);
+    check(sizeof(T));
+    T value;
+    memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+    return value;
+  }
+  ExecPath get_epath() {
+    size_t size = get<uint32_t>();
+    check(size * sizeof(PCID));
+    ExecPath epath(size);
+    memcpy(epath.data(), cursor, size * sizeof(PCID));
+    cursor += size * sizeof(PCID);
+    return epath;
+  }
+  std::string get_string() {
+    size_t size = get<uint32_t>();
+    check(size);
+    std::string str((const char*)cursor, size);
+    cursor += size;
+    return str;
+  }
+  bool at_end() const { return cursor == end; }
+  void check(bool cond, const std::string& what) {
+    PATHFINDER_CHECK(cond, "PathFinder Error: Invalid snapshot `" + filename +
+                               "`: " + what);
+  }
+
+ private:
+  void check(size_t size) {
+    check(size <= (size_t)(end - cursor), "unexpected end of file");
+  }
+
+  std::string filename;
+  const uint8_t* cursor;
+  const uint8_t* end;
+};
+
+static std::unique_ptr<BoolExpr> parse_boolexpr(const std::string& str) {
+  return std::make_unique<BoolExpr>(
+      *parse_fun("(define-fun f () Bool " + str + ")")->get_body());
+}
+
+void Snapshot::save(const std::string& filename, const ExecTree& exectree,
+                    TracePC* tpc) {
+  Writer writer;
+  writer.put<uint64_t>(SNAPSHOT_MAGIC);
+  writer.put<uint32_t>(VERSION);
+  writer.put<uint64_t>(tpc->NumGuards);
+  writer.put<uint64_t>(params_size());
+
+  writer.put_epath(tpc->GetNewND(0));
+  ExecPath covered;
+  if (tpc->covered_pc_bitmap.is_available())
+    for (size_t i = 0; i < tpc->NumGuards; i++)
+      if (tpc->covered_pc_bitmap.is_set(i)) covered.push_back(i + 1);
+  writer.put_epath(covered);
+
+  writer.put<uint8_t>(!exectree.is_empty());
+  if (!exectree.is_empty()) save_node(writer, exectree.get_root());
+
+  // Written aside and renamed, so that a crash never leaves a partial file.
+  std::string temp_filename = filename + ".tmp";
+  std::ofstream file(temp_filename, std::ios::binary | std::ios::trunc);
+  file.write(writer.buffer.data(), writer.buffer.size());
+  file.close();
+  PATHFINDER_CHECK(!file.fail(),
+                   "PathFinder Error: Failed to write snapshot `" +
+                       temp_filename + "`");
+  fs::rename(temp_filename, filename);
+}
+void Snapshot::save_node(Writer& writer, const Node* node) {
+  writer.put<uint8_t>(node->is_leaf());
+  writer.put_epath(node->get_prefix());
+  save_cond(writer, node->cond.get());
+
+  if (node->is_leaf()) {
+    const LeafNode* leaf = as_leaf(node);
+    std::set<Input> inputset = leaf->is_spilled()
+                                   ? leaf->exectree->spilled_inputset(leaf)
+                                   : std::set<Input>(leaf->inputset.begin(),
+                                                     leaf->inputset.end());
+    writer.put<uint8_t>(leaf->exception_path);
+    writer.put_epath(leaf->get_tail());
+    writer.put<uint64_t>(leaf->num_seen);
+    writer.put<uint32_t>(inputset.size());
+    for (auto& input : inputset) {
+      std::vector<long> data = serialize(input);
+      writer.put<uint32_t>(data.size());
+      for (long value : data) writer.put<int64_t>(value);
+    }
+  } else {
+    const InternalNode* internal = as_internal(node);
+    writer.put<uint32_t>(internal->children.size());
+    for (auto& child : internal->children) save_node(writer, child.get());
+  }
+}
+void Snapshot::save_cond(Writer& writer, const BranchCondition* cond) {
+  assert(cond != nullptr);
+  CondType condtype = cond->get_condtype();
+  writer.put<uint8_t>(condtype);
+  writer.put<int64_t>(cond->cmat.tp);
+  writer.put<int64_t>(cond->cmat.tn);
+  writer.put<int64_t>(cond->cmat.fp);
+  writer.put<int64_t>(cond->cmat.fn);
+  writer.put<int64_t>(cond->get_synthesis_budget());
+
+  if (condtype == CT_ENUM) {
+    const EnumCondition* enum_cond = static_cast<const EnumCondition*>(cond);
+    writer.put<uint8_t>(enum_cond->inclusion_cond.has_value());
+    if (enum_cond->inclusion_cond.has_value()) {
+      writer.put_string(enum_cond->inclusion_cond->name);
+      writer.put<uint64_t>(enum_cond->inclusion_cond->bitvec);
+    }
+    writer.put_string(enum_cond->equality_cond == nullptr
+                          ? ""
+                          : enum_cond->equality_cond->to_string());
+  } else if (condtype == CT_NUMERIC) {
+    const NumericCondition* numeric_cond =
+        static_cast<const NumericCondition*>(cond);
+    writer.put_string(
+        numeric_cond->cond == nullptr ? "" : numeric_cond->cond->to_string());
+  }
+}
+
+void Snapshot::load(const std::string& filename, ExecTree& exectree,
+                    TracePC* tpc) {
+  assert(exectree.is_empty());
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  PATHFINDER_CHECK(fd >= 0,
+                   "PathFinder Error: No such file `" + filename + "`");
+  struct stat st;
+  PATHFINDER_CHECK(fstat(fd, &st) == 0, "PathFinder Error: Failed to stat "
+                                        "snapshot `" + filename + "`");
+  size_t size = st.st_size;
+  void* data = size == 0 ? nullptr
+                         : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  PATHFINDER_CHECK(data != MAP_FAILED, "PathFinder Error: Failed to map "
+                                       "snapshot `" + filename + "`");
+
+  Reader reader(filename, (const uint8_t*)data, size);
+  reader.check(reader.get<uint64_t>() == SNAPSHOT_MAGIC, "not a snapshot");
+  reader.check(reader.get<uint32_t>() == VERSION, "unsupported version");
+  reader.check(reader.get<uint64_t>() == tpc->NumGuards,
+               "taken from a different build of the target");
+  reader.check(reader.get<uint64_t>() == params_size(),
+               "taken with different arguments");
+
+  ExecPath nd_pcids = reader.get_epath();
+  ExecPath covered = reader.get_epath();
+  for (auto& pcid : nd_pcids)
+    reader.check(0 < pcid && pcid <= tpc->NumGuards, "invalid PC");
+  for (auto& pcid : covered)
+    reader.check(0 < pcid && pcid <= tpc->NumGuards, "invalid PC");
+
+  tpc->AddND(nd_pcids);
+  tpc->InitCoveredBitMap();
+  for (auto& pcid : covered)
+    if (tpc->covered_pc_bitmap.test_and_set(pcid - 1))
+      tpc->state->num_covered++;
+
+  if (reader.get<uint8_t>()) load_node(reader, exectree, nullptr);
+  reader.check(reader.at_end(), "trailing data");
+  if (data != nullptr) munmap(data, size);
+
+  for (auto& leaf : exectree.get_leaves()) leaf->update_aggregates();
+  exectree.rebuild_path_index();
+  // Prefixes and tails were saved pruned.
+  exectree.num_nd_pruned = nd_pcids.size();
+}
+void Snapshot::load_node(Reader& reader, ExecTree& exectree,
+                         InternalNode* parent) {
+  bool is_leaf = reader.get<uint8_t>();
+  ExecPath prefix = reader.get_epath();
+  reader.check(!prefix.empty(), "empty prefix");
+  std::unique_ptr<BranchCondition> cond = load_cond(reader);
+  if (parent == nullptr) cond = nullptr;
+
+  if (is_leaf) {
+    std::unique_ptr<LeafNode> leaf = exectree.create_leaf(prefix);
+    leaf->exception_path = reader.get<uint8_t>();
+    leaf->tail = reader.get_epath();
+    leaf->num_seen = reader.get<uint64_t>();
+    size_t num_inputs = reader.get<uint32_t>();
+    for (size_t i = 0; i < num_inputs; i++) {
+      std::vector<long> data(reader.get<uint32_t>());
+      for (auto& value : data) value = reader.get<int64_t>();
+      std::optional<Input> input = deserialize(data);
+      reader.check(input.has_value(), "invalid input");
+      leaf->put_input(input.value());
+    }
+    exectree.index_pcids(leaf.get(), leaf->tail);
+    exectree.add_node(std::move(leaf), parent, std::move(cond));
+  } else {
+    Node* internal = exectree.add_node(exectree.create_internal(prefix),
+                                       parent, std::move(cond));
+    size_t num_children = reader.get<uint32_t>();
+    for (size_t i = 0; i < num_children; i++)
+      load_node(reader, exectree, as_internal(internal));
+  }
+}
+std::unique_ptr<BranchCondition> Snapshot::load_cond(Reader& reader) {
+  CondType condtype = (CondType)reader.get<uint8_t>();
+  int64_t tp = reader.get<int64_t>();
+  int64_t tn = reader.get<int64_t>();
+  int64_t fp = reader.get<int64_t>();
+  int64_t fn = reader.get<int64_t>();
+  int64_t synthesis_budget = reader.get<int64_t>();
+
+  std::unique_ptr<BranchCondition> cond;
+  if (condtype == CT_ENUM) {
+    std::unique_ptr<EnumCondition> enum_cond =
+        std::make_unique<EnumCondition>();
+    enum_cond->inclusion_cond = std::nullopt;
+    if (reader.get<uint8_t>()) {
+      std::string name = reader.get_string();
+      EnumArgBitVec bv;
+      if (!name.empty()) {
+        EnumArgBitVecArray enum_bvs = initial_enum_bvs(false);
+        reader.check(enum_bvs.get_idx_map().count(name) > 0,
+                     "unknown enum argument `" + name + "`");
+        bv = *enum_bvs[name];
+      }
+      bv.bitvec = reader.get<uint64_t>();
+      enum_cond->inclusion_cond = bv;
+    }
+    std::string equality_cond = reader.get_string();
+    if (!equality_cond.empty())
+      enum_cond->equality_cond = parse_boolexpr(equality_cond);
+    cond = std::move(enum_cond);
+  } else if (condtype == CT_NUMERIC) {
+    std::unique_ptr<NumericCondition> numeric_cond =
+        std::make_unique<NumericCondition>();
+    std::string numeric_cond_str = reader.get_string();
+    if (!numeric_cond_str.empty())
+      numeric_cond->cond = parse_boolexpr(numeric_cond_str);
+    cond = std::move(numeric_cond);
+  } else {
+    reader.check(condtype == CT_NEGLECT, "invalid condition");
+    cond = std::make_unique<NeglectCondition>();
+  }
+
+  cond->cmat = ConfusionMatrix(tp, tn, fp, fn);
+  cond->set_synthesis_budget(synthesis_budget);
+  return cond;
+}
+
+}  // namespace pathfinder
@@ -0,0 +1,101 @@
+#include "spill_file.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <iterator>
+
+#include "utils.h"
+
+namespace pathfinder {
+
+SpillFile::SpillFile() {
+  std::string filename =
+      (fs::temp_directory_path() / "pathfinder_spill_XXXXXX").string();
+  fd = mkstemp(filename.data());
+  PATHFINDER_CHECK(fd >= 0, "PathFinder Error: Failed to create spill file `" +
+                                filename + "`");
+  // Removed right away, so that it is gone however the fuzzer exits.
+  unlink(filename.c_str());
+
+  // Pages past the end of the file are never touched, as records are only
+  // read once written.
+  void* mem =
+      mmap(nullptr, MAX_SIZE, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
+  PATHFINDER_CHECK(mem != MAP_FAILED,
+                   "PathFinder Error: Failed to map spill file");
+  mapping = (const uint32_t*)mem;
+}
+SpillFile::~SpillFile() {
+  munmap((void*)mapping, MAX_SIZE);
+  close(fd);
+}
+uint64_t SpillFile::write(const std::vector<uint32_t>& words) {
+  uint64_t offset;
+  auto fit = free_sizes.lower_bound({words.size(), 0});
+  if (fit != free_sizes.end()) {
+    offset = fit->second;
+    size_t size = fit->first;
+    remove_free_range(free_ranges.find(offset));
+    if (size > words.size())
+      add_free_range(offset + words.size(), size - words.size());
+  } else {
+    PATHFINDER_CHECK(
+        (num_words + words.size()) * sizeof(uint32_t) <= MAX_SIZE,
+        "PathFinder Error: Spill file is full");
+    offset = num_words;
+    num_words += words.size();
+  }
+
+  const char* data = (const char*)words.data();
+  size_t size = words.size() * sizeof(uint32_t);
+  size_t written = 0;
+  while (written < size) {
+    ssize_t ret = pwrite(fd, data + written, size - written,
+                         offset * sizeof(uint32_t) + written);
+    PATHFINDER_CHECK(ret > 0, "PathFinder Error: Failed to write spill file");
+    written += ret;
+  }
+  return offset;
+}
+void SpillFile::free(uint64_t offset, size_t size) {
+  assert(offset + size <= num_words);
+  auto next = free_ranges.lower_bound(offset);
+  if (next != free_ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      remove_free_range(prev);
+    }
+  }
+  if (next != free_ranges.end() && offset + size == next->first) {
+    size += next->second;
+    remove_free_range(next);
+  }
+
+  if (offset + size < num_words) {
+    add_free_range(offset, size);
+    return;
+  }
+  // Freed at the end, where the file is cut back.
+  num_words = offset;
+  PATHFINDER_CHECK(ftruncate(fd, num_words * sizeof(uint32_t)) == 0,
+                   "PathFinder Error: Failed to truncate spill file");
+}
+const uint32_t* SpillFile::at(uint64_t offset) const {
+  assert(offset < num_words);
+  return mapping + offset;
+}
+size_t SpillFile::size() const { return num_words; }
+void SpillFile::add_free_range(uint64_t offset, size_t size) {
+  free_ranges.insert({offset, size});
+  free_sizes.insert({size, offset});
+}
+void SpillFile::remove_free_range(std::map<uint64_t, size_t>::iterator it) {
+  free_sizes.erase({it->second, it->first});
+  free_ranges.erase(it);
+}
+
+}  // namespace pathfinder
@@ -1,6 +1,9 @@
 #include "sygus_gen.h"
 
+#include <map>
+
 #include "input_signature.h"
+#include "options.h"
 #include "utils.h"
 
 namespace pathfinder {
@@ -140,6 +143,32 @@ const std::string const_symbol = "ConstExpr";
 const std::string var_symbol = "VarExpr";
 const std::set<int> default_literals = {0, 1, 2, 3, 4, 5};
 
+// Number of executions compared against each constant so far.
+std::map<int, size_t> literal_frequency;
+
+void count_literals(const std::vector<int>& literals) {
+  for (int literal : literals) literal_frequency[literal]++;
+}
+
+std::set<int> grammar_literals() {
+  // Default literals, and CMP_LITERALS most frequent constants of
+  // comparisons in target function.
+  std::set<int> literals = default_literals;
+  std::vector<std::pair<size_t, int>> ranked;
+  for (auto& [literal, frequency] : literal_frequency)
+    if (default_literals.find(literal) == default_literals.end())
+      ranked.push_back({frequency, literal});
+  std::sort(ranked.begin(), ranked.end(),
+            [](const std::pair<size_t, int>& l,
+               const std::pair<size_t, int>& r) {
+              return l.first != r.first ? l.first > r.first
+                                        : l.second < r.second;
+            });
+  for (size_t i = 0; i < ranked.size() && i < CMP_LITERALS; i++)
+    literals.insert(ranked[i].second);
+  return literals;
+}
+
 std::vector<std::unique_ptr<ProductionRule>> rule_enum() {
   std::vector<std::unique_ptr<ProductionRule>> rules;
 
@@ -179,7 +208,7 @@ const std::string int_symbol1 = "IntExpr1";
 const std::string int_symbol2 = "IntExpr2";
 
 std::unique_ptr<ProductionRule> const_rule() {
-  std::set<int> literals = default_literals;
+  std::set<int> literals = grammar_literals();
   std::vector<int> literals_sorted(literals.begin(), literals.end());
   std::sort(literals_sorted.begin(), literals_sorted.end());
 
@@ -335,7 +364,7 @@ std::unique_ptr<ProductionRule> int_rule1_numeric_nonlinear_simple() {
   return std::make_unique<ProductionRule>(int_symbol1, std::move(irhs));
 }
 std::unique_ptr<ProductionRule> int_rule2_numeric_nonlinear_simple() {
-  std::set<int> literals = default_literals;
+  std::set<int> literals = grammar_literals();
   std::vector<int> literals_sorted(literals.begin(), literals.end());
   std::sort(literals_sorted.begin(), literals_sorted.end());
 
@@ -382,7 +411,7 @@ std::unique_ptr<ProductionRule> bool_rule_numeric_nonlinear_complex() {
   return std::make_unique<ProductionRule>(start_symbol, std::move(brhs));
 }
 std::unique_ptr<ProductionRule> int_rule_numeric_nonlinear_complex() {
-  std::set<int> literals = default_literals;
+  std::set<int> literals = grammar_literals();
   std::vector<int> literals_sorted(literals.begin(), literals.end());
   std::sort(literals_sorted.begin(), literals_sorted.end());
 
@@ -1,6 +1,10 @@
 #include "trace_pc.h"
 
+#include <cxxabi.h>
+#include <dlfcn.h>
+
 #include <sstream>
+#include <unordered_map>
 
 #include "utils.h"
 
@@ -19,19 +23,107 @@ TracePC::TracePC(size_t max_significant_execpath_size_) {
 
   NumGuards = 0;
   PathLog = new PCID[max_significant_execpath_size + max_tail_execpath_size];
-  PathLogSize = 0;
+  state = new RunState();
+  state->path_log_size = 0;
+  state->path_hash = PATH_HASH_SEED;
+  state->num_covered = 0;
+  state->num_new_covered = 0;
+  state->num_cmp_literals = 0;
+  NewCovered = nullptr;
+  shared_memory = false;
   trace = false;
+
+  loop_max_period = 0;
+  ResetLoopState();
+  patience_diff = false;
+  num_votes = 0;
+  thread_policy = THREAD_SHARED;
+  epoch = 0;
+  merged_epoch = 0;
+  collect_cmp_literals = false;
 }
 TracePC::~TracePC() {
-  if (PathLog != nullptr) delete[] PathLog;
+  if (shared_memory) {
+    munmap(PathLog, sizeof(PCID) * ExecPathMax());
+    if (NewCovered != nullptr) munmap(NewCovered, sizeof(PCID) * NumGuards);
+    munmap(state, sizeof(RunState));
+  } else {
+    delete[] PathLog;
+    delete[] NewCovered;
+    delete state;
+  }
 }
 void TracePC::HandleInit(uint32_t* Start, uint32_t* Stop) {
   if (Start == Stop || *Start) return;
+  modules.push_back({Start, Stop, nullptr});
   for (uint32_t* P = Start; P < Stop; P++) {
     NumGuards++;
     *P = NumGuards;
+    guards.push_back(P);
   }
 }
+
+void TracePC::HandlePCsInit(const uintptr_t* PCsBeg, const uintptr_t* PCsEnd) {
+  // Called right after `HandleInit` of the same module, which is skipped for
+  // modules without guards or seen already, so the table is dropped unless
+  // it fits the last module registered.
+  if (modules.empty()) return;
+  Module& module = modules.back();
+  size_t num_pcs = (PCsEnd - PCsBeg) / 2;
+  if (module.pcs == nullptr && (size_t)(module.stop - module.start) == num_pcs)
+    module.pcs = PCsBeg;
+}
+
+static std::string function_name_of(const Dl_info& info) {
+  if (info.dli_sname == nullptr) return "";
+  int status;
+  char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr,
+                                        &status);
+  if (demangled == nullptr) return info.dli_sname;
+  std::string name = demangled;
+  free(demangled);
+  return name;
+}
+
+size_t TracePC::FilterPCs(const std::vector<std::string>& allowlist,
+                          const std::vector<std::string>& denylist) {
+  // Disable PCs in functions or modules, whose names contain none of
+  // `allowlist` (if not empty) or any of `denylist`.
+  auto matches = [](const std::vector<std::string>& list,
+                    const std::string& function, const std::string& module) {
+    for (auto& pattern : list)
+      if (function.find(pattern) != std::string::npos ||
+          module.find(pattern) != std::string::npos)
+        return true;
+    return false;
+  };
+
+  std::unordered_map<const void*, bool> filtered_function;
+  size_t num_filtered = 0;
+  for (auto& module : modules) {
+    if (module.pcs == nullptr) continue;
+    for (size_t i = 0; i < (size_t)(module.stop - module.start); i++) {
+      if (module.start[i] == 0) continue;
+
+      Dl_info info;
+      if (dladdr((void*)module.pcs[2 * i], &info) == 0) continue;
+      auto it = filtered_function.find(info.dli_saddr);
+      if (it == filtered_function.end()) {
+        std::string function = function_name_of(info);
+        std::string module_name = info.dli_fname ? info.dli_fname : "";
+        bool filtered = (!allowlist.empty() &&
+                         !matches(allowlist, function, module_name)) ||
+                        matches(denylist, function, module_name);
+        it = filtered_function.insert({info.dli_saddr, filtered}).first;
+      }
+      if (it->second) {
+        module.start[i] = 0;
+        num_filtered++;
+      }
+    }
+  }
+  return num_filtered;
+}
 size_t TracePC::ExecPathSignificantMax() const {
   return max_significant_execpath_size;
 }
@@ -44,21 +136,20 @@ size_t TracePC::ExecPathMax() const {
 
 size_t TracePC::CheckDiffChunkSize() const { return check_diff_chunk_size; }
 
-ExecPath TracePC::significant(ExecPath epath) const {
+ExecPathView TracePC::significant(ExecPathView epath) const {
   if (epath.size() <= ExecPathSignificantMax()) return epath;
-  return subvec(epath, 0, ExecPathSignificantMax());
+  return epath.subview(0, ExecPathSignificantMax());
 }
 
-ExecPath TracePC::tail_of(ExecPath epath) const {
-  if (epath.size() <= ExecPathSignificantMax()) return {};
+ExecPathView TracePC::tail_of(ExecPathView epath) const {
+  if (epath.size() <= ExecPathSignificantMax()) return ExecPathView();
   size_t len = epath.size() - ExecPathSignificantMax() <= ExecPathTailMax()
                    ? epath.size() - ExecPathSignificantMax()
                    : ExecPathTailMax();
-  return subvec(epath, ExecPathSignificantMax(), len);
+  return epath.subview(ExecPathSignificantMax(), len);
 }
 
-bool TracePC::eq_significant(const ExecPath& left,
-                             const ExecPath& right) const {
+bool TracePC::eq_significant(ExecPathView left, ExecPathView right) const {
   if (left.size() >= ExecPathSignificantMax() &&
       right.size() >= ExecPathSignificantMax()) {
     for (size_t i = 0; i < ExecPathSignificantMax(); i++)
@@ -73,12 +164,12 @@ bool TracePC::eq_significant(const ExecPath& left,
   return true;
 }
 
-bool TracePC::truncated(const ExecPath& epath) const {
+bool TracePC::truncated(ExecPathView epath) const {
   return epath.size() == ExecPathMax();
 }
 
-bool TracePC::considerably_longer(const ExecPath& left,
-                                  const ExecPath& right) const {
+bool TracePC::considerably_longer(ExecPathView left,
+                                  ExecPathView right) const {
   // Currently, this criteria is not a known solution
   // nor thoroughly demonstrated, but just a trial.
 
@@ -94,13 +185,98 @@ bool TracePC::considerably_longer(const ExecPath& left,
   }
 }
 
-void TracePC::TraceOn() { trace = true; }
-void TracePC::TraceOff() { trace = false; }
+uint64_t TracePC::PathHash(ExecPathView epath) const {
+  // Same as the hash that `AppendPathLog` computes incrementally.
+  uint64_t hash = PATH_HASH_SEED;
+  size_t size = std::min(epath.size(), ExecPathSignificantMax());
+  for (size_t i = 0; i < size; i++) hash = HashPCID(hash, epath[i]);
+  return hash;
+}
+
+void TracePC::TraceOn() {
+  main_thread = std::this_thread::get_id();
+  trace = true;
+}
+
+void TracePC::TraceOff() {
+  trace = false;
+  if (thread_policy == THREAD_CONCAT || thread_policy == THREAD_MERGE)
+    MergeThreadLogs();
+}
+
+void TracePC::SetThreadPolicy(THREAD_POLICY policy) { thread_policy = policy; }
+
+void TracePC::ClearPathLog() {
+  epoch++;
+  state->path_log_size = 0;
+  state->path_hash = PATH_HASH_SEED;
+  state->num_new_covered = 0;
+  state->num_cmp_literals = 0;
+  ResetLoopState();
+}
 
-void TracePC::ClearPathLog() { PathLogSize = 0; }
+void TracePC::SetLoopCompression(size_t max_period,
+                                 const std::vector<size_t>& buckets) {
+  PATHFINDER_CHECK(std::is_sorted(buckets.begin(), buckets.end()) &&
+                       std::adjacent_find(buckets.begin(), buckets.end()) ==
+                           buckets.end(),
+                   "PathFinder Error: Loop buckets should be strictly "
+                   "increasing");
+  loop_max_period = max_period;
+  loop_buckets = buckets;
+  loop_history = std::vector<PCID>(max_period, 0);
+  loop_match = std::vector<size_t>(max_period + 1, 0);
+  ResetLoopState();
+}
+
+void TracePC::ResetLoopState() {
+  std::fill(loop_match.begin(), loop_match.end(), 0);
+  loop_history_size = 0;
+  loop_period = 0;
+  loop_phase = 0;
+  loop_iter = 0;
+  loop_next_bucket = 0;
+}
+
+void* map_shared(size_t size) {
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  PATHFINDER_CHECK(mem != MAP_FAILED,
+                   "PathFinder Error: Failed to map shared memory");
+  return mem;
+}
+
+void TracePC::MapSharedMemory() {
+  if (shared_memory) return;
+  shared_memory = true;
+
+  PCID* shared_path_log = (PCID*)map_shared(sizeof(PCID) * ExecPathMax());
+  memcpy(shared_path_log, PathLog, sizeof(PCID) * state->path_log_size);
+  delete[] PathLog;
+  PathLog = shared_path_log;
+
+  RunState* shared_state = (RunState*)map_shared(sizeof(RunState));
+  *shared_state = *state;
+  delete state;
+  state = shared_state;
+
+  covered_pc_bitmap.share();
+  if (NewCovered != nullptr) {
+    PCID* shared_new_covered = (PCID*)map_shared(sizeof(PCID) * NumGuards);
+    memcpy(shared_new_covered, NewCovered,
+           sizeof(PCID) * state->num_new_covered);
+    delete[] NewCovered;
+    NewCovered = shared_new_covered;
+  }
+}
 
 void TracePC::InitCoveredBitMap() {
-  if (!covered_pc_bitmap.is_available()) covered_pc_bitmap.init(NumGuards);
+  if (covered_pc_bitmap.is_available()) return;
+  covered_pc_bitmap.init(NumGuards, shared_memory);
+  NewCovered = shared_memory ? (PCID*)map_shared(sizeof(PCID) * NumGuards)
+                             : new PCID[NumGuards];
+  state->num_covered = 0;
+  state->num_new_covered = 0;
 }
 
 void TracePC::InitNDBitMap() {
@@ -113,17 +289,208 @@ inline bool TracePC::IsND(PCID pcid) {
   return nondeterministic_pc_bitmap.is_set(pcid - 1);
 }
 
+inline void TracePC::MarkND(PCID pcid) {
+  if (nondeterministic_pc_bitmap.is_set(pcid - 1)) return;
+  nondeterministic_pc_bitmap.set(pcid - 1);
+  *guards[pcid - 1] = 0;
+  nd_pcids.push_back(pcid);
+}
+
 void TracePC::AppendPathLog(PCID pcid) {
   if (!trace) return;
 
-  if (covered_pc_bitmap.is_available()) covered_pc_bitmap.set(pcid - 1);
+  if (covered_pc_bitmap.is_available() &&
+      covered_pc_bitmap.test_and_set(pcid - 1)) {
+    // Other threads may cover PCs at the same time, so each reserves its own
+    // slot of `NewCovered`.
+    size_t slot =
+        __atomic_fetch_add(&state->num_new_covered, 1, __ATOMIC_RELAXED);
+    if (slot < NumGuards) NewCovered[slot] = pcid;
+    __atomic_fetch_add(&state->num_covered, 1, __ATOMIC_RELAXED);
+  }
+
+  if (state->path_log_size == ExecPathMax() ||
+      (nondeterministic_pc_bitmap.is_available() && IsND(pcid)))
+    return;
+
+  if (thread_policy != THREAD_SHARED &&
+      std::this_thread::get_id() != main_thread) {
+    if (thread_policy != THREAD_MAIN) AppendThreadLog(pcid);
+    return;
+  }
+
+  if (loop_max_period == 0)
+    EmitPathLog(pcid);
+  else
+    AppendLoopCompressed(pcid);
+}
+
+inline void TracePC::EmitPathLog(PCID pcid) {
+  if (state->path_log_size == ExecPathMax()) return;
+  if (state->path_log_size < max_significant_execpath_size)
+    state->path_hash = HashPCID(state->path_hash, pcid);
+  PathLog[state->path_log_size++] = pcid;
+}
+
+struct ThreadTraceSlot {
+  TracePC* owner = nullptr;
+  TracePC::ThreadTrace* trace = nullptr;
+  ~ThreadTraceSlot() {
+    if (trace != nullptr) trace->exited = true;
+  }
+};
+static thread_local ThreadTraceSlot thread_trace_slot;
+
+void TracePC::AppendThreadLog(PCID pcid) {
+  size_t current_epoch = epoch;
+  ThreadTraceSlot& slot = thread_trace_slot;
+  if (slot.owner != this) {
+    auto new_trace = std::make_unique<ThreadTrace>();
+    new_trace->epoch = current_epoch;
+    new_trace->size = 0;
+    new_trace->cursor = &new_trace->head;
+    new_trace->exited = false;
+    std::lock_guard<std::mutex> lock(thread_traces_mutex);
+    thread_traces.push_back(std::move(new_trace));
+    slot.owner = this;
+    slot.trace = thread_traces.back().get();
+  }
+
+  ThreadTrace* thread_trace = slot.trace;
+  size_t size = thread_trace->size.load(std::memory_order_relaxed);
+  if (thread_trace->epoch.load(std::memory_order_relaxed) != current_epoch) {
+    size = 0;
+    thread_trace->cursor = &thread_trace->head;
+    thread_trace->size.store(0, std::memory_order_relaxed);
+    thread_trace->epoch.store(current_epoch, std::memory_order_release);
+  }
+  if (size == ExecPathMax()) return;
+
+  size_t offset = size % ThreadTrace::CHUNK_SIZE;
+  if (size > 0 && offset == 0) {
+    ThreadTrace::Chunk* cursor = thread_trace->cursor;
+    if (cursor->next == nullptr)
+      cursor->next = std::make_unique<ThreadTrace::Chunk>();
+    thread_trace->cursor = cursor->next.get();
+  }
+  thread_trace->cursor->pcids[offset] = pcid;
+  thread_trace->size.store(size + 1, std::memory_order_release);
+}
+
+void TracePC::MergeThreadLogs() {
+  size_t current_epoch = epoch;
+  if (merged_epoch == current_epoch) return;
+  merged_epoch = current_epoch;
+
+  // PCs a thread appends while being read are past `size`, so left out.
+  std::vector<PCID> merged;
+  std::lock_guard<std::mutex> lock(thread_traces_mutex);
+  for (auto& thread_trace : thread_traces) {
+    if (thread_trace->epoch.load(std::memory_order_acquire) != current_epoch)
+      continue;
+    size_t size = thread_trace->size.load(std::memory_order_acquire);
+    const ThreadTrace::Chunk* chunk = &thread_trace->head;
+    for (size_t i = 0; i < size; i++) {
+      if (i > 0 && i % ThreadTrace::CHUNK_SIZE == 0) chunk = chunk->next.get();
+      merged.push_back(chunk->pcids[i % ThreadTrace::CHUNK_SIZE]);
+    }
+  }
+  if (thread_policy == THREAD_MERGE) {
+    std::sort(merged.begin(), merged.end());
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+  }
+  for (PCID pcid : merged) EmitPathLog(pcid);
+
+  thread_traces.erase(
+      std::remove_if(thread_traces.begin(), thread_traces.end(),
+                     [](const std::unique_ptr<ThreadTrace>& thread_trace) {
+                       return thread_trace->exited.load();
+                     }),
+      thread_traces.end());
+}
+
+void TracePC::AppendLoopCompressed(PCID pcid) {
+  // The loop body is the last `loop_period` entries of `loop_history`.
+  auto body = [this](size_t i) {
+    return loop_history[(loop_history_size - loop_period + i) %
+                        loop_max_period];
+  };
+
+  if (loop_period != 0) {
+    if (pcid == body(loop_phase)) {
+      if (++loop_phase < loop_period) return;
+      loop_phase = 0;
+      loop_iter++;
+      if (loop_next_bucket < loop_buckets.size() &&
+          loop_iter == loop_buckets[loop_next_bucket]) {
+        for (size_t i = 0; i < loop_period; i++) EmitPathLog(body(i));
+        loop_next_bucket++;
+      }
+      return;
+    }
+
+    // Left the loop in the middle of an iteration. Replay the partial
+    // iteration as if no loop had been seen.
+    std::vector<PCID> partial;
+    for (size_t i = 0; i < loop_phase; i++) partial.push_back(body(i));
+    ResetLoopState();
+    for (PCID p : partial) AppendLoopCompressed(p);
+    if (loop_period != 0) {
+      AppendLoopCompressed(pcid);
+      return;
+    }
+  }
+
+  EmitPathLog(pcid);
+
+  size_t found_period = 0;
+  for (size_t p = 1; p <= loop_max_period && p <= loop_history_size; p++) {
+    if (loop_history[(loop_history_size - p) % loop_max_period] == pcid) {
+      loop_match[p]++;
+      if (found_period == 0 && loop_match[p] >= p) found_period = p;
+    } else {
+      loop_match[p] = 0;
+    }
+  }
+  loop_history[loop_history_size % loop_max_period] = pcid;
+  loop_history_size++;
+
+  if (found_period != 0) {
+    // The last two iterations are already in the path log.
+    loop_period = found_period;
+    loop_phase = 0;
+    loop_iter = 2;
+    loop_next_bucket = std::upper_bound(loop_buckets.begin(),
+                                        loop_buckets.end(), loop_iter) -
+                       loop_buckets.begin();
+  }
+}
+
+void TracePC::CollectCmpLiterals(bool collect) {
+  collect_cmp_literals = collect;
+}
+
+void TracePC::HandleConstCmp(uint64_t value, size_t width) {
+  if (!trace || !collect_cmp_literals) return;
+
+  // Operands narrower than 4 bytes are mostly unsigned, e.g., bool or char.
+  int64_t literal = width == 4 ? (int32_t)value : (int64_t)value;
+  if (literal < 0 || literal > MAX_CMP_LITERAL) return;
+
+  const size_t max_literals =
+      sizeof(state->cmp_literals) / sizeof(state->cmp_literals[0]);
+  for (size_t i = 0; i < state->num_cmp_literals; i++)
+    if (state->cmp_literals[i] == literal) return;
+  if (state->num_cmp_literals < max_literals)
+    state->cmp_literals[state->num_cmp_literals++] = literal;
+}
 
-  if (PathLogSize < max_significant_execpath_size + max_tail_execpath_size &&
-      (!nondeterministic_pc_bitmap.is_available() || !IsND(pcid)))
-    PathLog[PathLogSize++] = pcid;
+std::vector<int> TracePC::GetCmpLiterals() const {
+  return std::vector<int>(state->cmp_literals,
+                          state->cmp_literals + state->num_cmp_literals);
 }
 
-ExecPath TracePC::Prune(PCID* epath, size_t size) {
+ExecPath TracePC::Prune(const PCID* epath, size_t size) {
   static PCID* pruned =
       new PCID[max_significant_execpath_size + max_tail_execpath_size];
 
@@ -134,22 +501,31 @@ ExecPath TracePC::Prune(PCID* epath, size_t size) {
   return ExecPath(pruned, pruned + pruned_size);
 }
 
-ExecPath TracePC::Prune(ExecPath epath) {
+ExecPath TracePC::Prune(ExecPathView epath) {
   return Prune(epath.data(), epath.size());
 }
 
-ExecPath TracePC::GetPathLog() {
+ExecPath TracePC::GetPathLog() { return GetPathLogView().to_vec(); }
+
+ExecPathView TracePC::GetPathLogView() const {
   // workaround to mitigate buffer overflow
-  size_t size = std::min(
-      PathLogSize, max_significant_execpath_size + max_tail_execpath_size);
-  return ExecPath(PathLog, PathLog + size);
+  size_t size = std::min(state->path_log_size, max_significant_execpath_size +
+                                                  max_tail_execpath_size);
+  return ExecPathView(PathLog, size);
 }
 
+uint64_t TracePC::GetPathHash() const { return state->path_hash; }
+
 size_t TracePC::GetNumInstrumented() { return NumGuards; }
 
 size_t TracePC::GetNumCovered() {
   assert(covered_pc_bitmap.is_available());
-  return covered_pc_bitmap.num_set_bit();
+  return state->num_covered;
+}
+
+ExecPathView TracePC::GetNewCovered() const {
+  if (NewCovered == nullptr) return ExecPathView();
+  return ExecPathView(NewCovered, std::min(state->num_new_covered, NumGuards));
 }
 
 size_t TracePC::GetNumND() {
@@ -157,27 +533,28 @@ size_t TracePC::GetNumND() {
   return nondeterministic_pc_bitmap.num_set_bit();
 }
 
-class NegIndexable {
- public:
-  NegIndexable(size_t size) : vec(ExecPath(size)) {}
-  NegIndexable(ExecPath vec_) : vec(std::move(vec_)) {}
-  PCID& operator[](int idx) { return vec[normal_idx(idx)]; }
+ExecPathView TracePC::GetNewND(size_t num_seen) const {
+  assert(num_seen <= nd_pcids.size());
+  return ExecPathView(nd_pcids.data() + num_seen, nd_pcids.size() - num_seen);
+}
 
- private:
-  ExecPath vec;
-  size_t normal_idx(int idx) { return idx = idx >= 0 ? idx : vec.size() + idx; }
-};
+void TracePC::SetPatienceDiff(bool patience) { patience_diff = patience; }
 
-std::tuple<size_t, size_t, size_t, size_t, size_t>
-find_middle_snake_myers_original(ExecPath& left, size_t left_start,
-                                 size_t left_size, ExecPath& right,
-                                 size_t right_start, size_t right_size) {
+// referred to
+// https://github.com/RobertElderSoftware/roberteldersoftwarediff/blob/master/myers_diff_and_variations.py
+std::tuple<size_t, size_t, size_t, size_t, size_t> TracePC::FindMiddleSnake(
+    const ExecPath& left, size_t left_start, size_t left_size,
+    const ExecPath& right, size_t right_start, size_t right_size) {
   size_t max = left_size + right_size;
   assert(max > 0);
   int delta = left_size - right_size;
 
-  NegIndexable vf(max * 2);
-  NegIndexable vb(max * 2);
+  // Both are sized by `CheckDiff` for the whole chunk, which bounds the
+  // diagonals of every subproblem.
+  int offset = diff_forward.size() / 2;
+  assert(diff_forward.size() >= 2 * max + 3);
+  int* vf = diff_forward.data() + offset;
+  int* vb = diff_backward.data() + offset;
 
   vf[1] = 0;
   vb[1] = 0;
@@ -202,7 +579,7 @@ find_middle_snake_myers_original(ExecPath& left, size_t left_start,
       vf[k] = x;
       if (delta % 2 != 0 && (-(k - delta)) >= -(d - 1) &&
           (-(k - delta)) <= (d - 1))
-        if (vf[k] + vb[-(k - delta)] >= left_size)
+        if (vf[k] + vb[-(k - delta)] >= (int)left_size)
           return std::make_tuple(2 * d - 1, x_i, y_i, x, y);
     }
     for (int k = -d; k <= d; k += 2) {
@@ -223,7 +600,7 @@ find_middle_snake_myers_original(ExecPath& left, size_t left_start,
       }
       vb[k] = x;
       if (delta % 2 == 0 && (-(k - delta)) >= -d && (-(k - delta)) <= d)
-        if (vb[k] + vf[-(k - delta)] >= left_size)
+        if (vb[k] + vf[-(k - delta)] >= (int)left_size)
           return std::make_tuple(2 * d, left_size - x, right_size - y,
                                  left_size - x_i, right_size - y_i);
     }
@@ -231,8 +608,9 @@ find_middle_snake_myers_original(ExecPath& left, size_t left_start,
   throw Unreachable();
 }
 
-void TracePC::CheckDiff(ExecPath& left, size_t left_start, size_t left_size,
-                        ExecPath& right, size_t right_start, size_t right_size,
+void TracePC::MyersDiff(const ExecPath& left, size_t left_start,
+                        size_t left_size, const ExecPath& right,
+                        size_t right_start, size_t right_size,
                         std::vector<bool>& shadow_left,
                         std::vector<bool>& shadow_right) {
   if (left_size == 0) {
@@ -247,8 +625,8 @@ void TracePC::CheckDiff(ExecPath& left, size_t left_start, size_t left_size,
   }
 
   size_t d, x, y, u, v;
-  std::tie(d, x, y, u, v) = find_middle_snake_myers_original(
-      left, left_start, left_size, right, right_start, right_size);
+  std::tie(d, x, y, u, v) = FindMiddleSnake(left, left_start, left_size, right,
+                                            right_start, right_size);
   if (d > 1) {
     size_t left_start_fist_half = left_start;
     size_t left_size_first_half = x;
@@ -259,10 +637,10 @@ void TracePC::CheckDiff(ExecPath& left, size_t left_start, size_t left_size,
     size_t right_start_second_half = right_start + v;
     size_t right_size_second_half = right_size - v;
 
-    CheckDiff(left, left_start_fist_half, left_size_first_half, right,
+    MyersDiff(left, left_start_fist_half, left_size_first_half, right,
               right_start_first_half, right_size_first_half, shadow_left,
               shadow_right);
-    CheckDiff(left, left_start_second_half, left_size_second_half, right,
+    MyersDiff(left, left_start_second_half, left_size_second_half, right,
               right_start_second_half, right_size_second_half, shadow_left,
               shadow_right);
   } else if (d == 1) {
@@ -286,11 +664,98 @@ void TracePC::CheckDiff(ExecPath& left, size_t left_start, size_t left_size,
   }
 }
 
-size_t remove_common_prefix(ExecPath& left, ExecPath& right) {
-  size_t common_length = common_prefix_length(left, right);
-  left = subvec(left, common_length);
-  right = subvec(right, common_length);
-  return common_length;
+// Anchors on PCIDs occurring exactly once on both sides, keeps the longest
+// sequence of them in the same order, and diffs the ranges in between.
+// Ranges without such PCIDs, typically loop bodies, are left to Myers.
+void TracePC::PatienceDiff(const ExecPath& left, size_t left_start,
+                           size_t left_size, const ExecPath& right,
+                           size_t right_start, size_t right_size,
+                           std::vector<bool>& shadow_left,
+                           std::vector<bool>& shadow_right) {
+  while (left_size > 0 && right_size > 0 &&
+         left[left_start] == right[right_start]) {
+    left_start++;
+    right_start++;
+    left_size--;
+    right_size--;
+  }
+  while (left_size > 0 && right_size > 0 &&
+         left[left_start + left_size - 1] ==
+             right[right_start + right_size - 1]) {
+    left_size--;
+    right_size--;
+  }
+  if (left_size == 0 || right_size == 0) {
+    MyersDiff(left, left_start, left_size, right, right_start, right_size,
+              shadow_left, shadow_right);
+    return;
+  }
+
+  struct Occurrence {
+    size_t num_left = 0;
+    size_t num_right = 0;
+    size_t right_idx = 0;
+  };
+  std::unordered_map<PCID, Occurrence> occurrences;
+  for (size_t i = left_start; i < left_start + left_size; i++)
+    occurrences[left[i]].num_left++;
+  for (size_t i = right_start; i < right_start + right_size; i++) {
+    auto it = occurrences.find(right[i]);
+    if (it == occurrences.end()) continue;
+    it->second.num_right++;
+    it->second.right_idx = i;
+  }
+
+  std::vector<std::pair<size_t, size_t>> uniques;
+  for (size_t i = left_start; i < left_start + left_size; i++) {
+    const Occurrence& occ = occurrences[left[i]];
+    if (occ.num_left == 1 && occ.num_right == 1)
+      uniques.push_back({i, occ.right_idx});
+  }
+  if (uniques.empty()) {
+    MyersDiff(left, left_start, left_size, right, right_start, right_size,
+              shadow_left, shadow_right);
+    return;
+  }
+
+  // Longest increasing subsequence of right indices by patience sorting.
+  std::vector<size_t> piles;
+  std::vector<int> prev(uniques.size(), -1);
+  for (size_t i = 0; i < uniques.size(); i++) {
+    auto it = std::lower_bound(piles.begin(), piles.end(), i,
+                               [&uniques](size_t top, size_t idx) {
+                                 return uniques[top].second <
+                                        uniques[idx].second;
+                               });
+    if (it != piles.begin()) prev[i] = *(it - 1);
+    if (it == piles.end())
+      piles.push_back(i);
+    else
+      *it = i;
+  }
+  std::vector<std::pair<size_t, size_t>> anchors;
+  for (int i = piles.back(); i != -1; i = prev[i])
+    anchors.push_back(uniques[i]);
+  std::reverse(anchors.begin(), anchors.end());
+
+  size_t left_pos = left_start;
+  size_t right_pos = right_start;
+  for (auto& anchor : anchors) {
+    PatienceDiff(left, left_pos, anchor.first - left_pos, right, right_pos,
+                 anchor.second - right_pos, shadow_left, shadow_right);
+    left_pos = anchor.first + 1;
+    right_pos = anchor.second + 1;
+  }
+  PatienceDiff(left, left_pos, left_start + left_size - left_pos, right,
+               right_pos, right_start + right_size - right_pos, shadow_left,
+               shadow_right);
+}
+
+void TracePC::CollectChunk(ExecPathView epath, size_t start, ExecPath& chunk,
+                           size_t limit) {
+  chunk.clear();
+  for (size_t i = start; i < epath.size() && chunk.size() < limit; i++)
+    if (!IsND(epath[i])) chunk.push_back(epath[i]);
 }
 
 inline void TracePC::AddND(ExecPath& epath, std::vector<bool>& shadow_epath,
@@ -299,7 +764,7 @@ inline void TracePC::AddND(ExecPath& epath, std::vector<bool>& shadow_epath,
 
   if (do_all) {
     for (size_t i = 0; i < epath.size(); i++)
-      if (shadow_epath[i] == true) nondeterministic_pc_bitmap.set(epath[i] - 1);
+      if (shadow_epath[i] == true) MarkND(epath[i]);
     return;
   }
 
@@ -314,7 +779,7 @@ inline void TracePC::AddND(ExecPath& epath, std::vector<bool>& shadow_epath,
     if (common_seen > common_half) break;
 
     if (shadow_epath[i] == true) {
-      nondeterministic_pc_bitmap.set(epath[i] - 1);
+      MarkND(epath[i]);
     } else {
       common_seen++;
     }
@@ -326,70 +791,105 @@ void TracePC::AddND(const ExecPath& epath) {
 
   InitNDBitMap();
 
-  for (size_t i = 0; i < epath.size(); i++)
-    nondeterministic_pc_bitmap.set(epath[i] - 1);
+  for (size_t i = 0; i < epath.size(); i++) MarkND(epath[i]);
 }
 
-// referred to
-// https://github.com/RobertElderSoftware/roberteldersoftwarediff/blob/master/myers_diff_and_variations.py
-void TracePC::CheckDiff(ExecPath left, ExecPath right) {
-  if (!nondeterministic_pc_bitmap.is_available()) InitNDBitMap();
+void TracePC::ClearVotes() {
+  for (PCID pcid : voted_pcids) {
+    vote_count[pcid - 1] = 0;
+    vote_stamp[pcid - 1] = 0;
+  }
+  voted_pcids.clear();
+  num_votes = 0;
+}
 
-  ExecPath left_pruned = left;
-  ExecPath right_pruned = right;
-  size_t common_length = remove_common_prefix(left_pruned, right_pruned);
-  assert(common_length < ExecPathSignificantMax());
-
-  bool is_last_iter = left_pruned.size() <= CheckDiffChunkSize() ||
-                      right_pruned.size() <= CheckDiffChunkSize();
-
-  size_t left_chunk_size, right_chunk_size;
-  ExecPath left_chunk, right_chunk;
-  if (is_last_iter) {
-    left_chunk_size = left_pruned.size();
-    left_chunk = left_pruned;
-    right_chunk_size = right_pruned.size();
-    right_chunk = right_pruned;
-  } else {
-    left_chunk_size = CheckDiffChunkSize();
-    left_chunk = subvec(left_pruned, 0, left_chunk_size);
-    right_chunk_size = CheckDiffChunkSize();
-    right_chunk = subvec(right_pruned, 0, right_chunk_size);
+void TracePC::Vote(ExecPathView epath) {
+  if (vote_count.size() != NumGuards) {
+    vote_count.assign(NumGuards, 0);
+    vote_stamp.assign(NumGuards, 0);
   }
 
-  std::vector<bool> shadow_left(left_chunk_size, false);
-  std::vector<bool> shadow_right(right_chunk_size, false);
+  num_votes++;
+  for (PCID pcid : epath) {
+    if (vote_stamp[pcid - 1] == num_votes) continue;
+    vote_stamp[pcid - 1] = num_votes;
+    if (vote_count[pcid - 1]++ == 0) voted_pcids.push_back(pcid);
+  }
+}
 
-  while (true) {
-    CheckDiff(left_chunk, 0, left_chunk_size, right_chunk, 0, right_chunk_size,
-              shadow_left, shadow_right);
-    AddND(left_chunk, shadow_left, is_last_iter);
-    AddND(right_chunk, shadow_right, is_last_iter);
+size_t TracePC::AddNDByVotes() {
+  // PCs missing in some of the voted paths are nondeterministic.
+  InitNDBitMap();
+
+  size_t num_new_nd = 0;
+  for (PCID pcid : voted_pcids) {
+    if (vote_count[pcid - 1] == num_votes || IsND(pcid)) continue;
+    MarkND(pcid);
+    num_new_nd++;
+  }
+  ClearVotes();
+  return num_new_nd;
+}
 
-    left_pruned = Prune(left);
-    right_pruned = Prune(right);
-    common_length = remove_common_prefix(left_pruned, right_pruned);
-    if (common_length >= ExecPathSignificantMax() ||
-        (left_pruned.size() == 0 && right_pruned.size() == 0))
-      break;
+void TracePC::CheckDiff(ExecPathView left, ExecPathView right) {
+  if (!nondeterministic_pc_bitmap.is_available()) InitNDBitMap();
 
-    is_last_iter = left_pruned.size() <= CheckDiffChunkSize() ||
-                   right_pruned.size() <= CheckDiffChunkSize();
+  // PCIDs are only ever added to ND, which drops the same PCIDs from both
+  // sides of a common prefix, so it stays common. Thus the cursors only
+  // advance, skipping ND PCIDs on the way, and each round reads no further
+  // than its chunk.
+  size_t left_pos = 0;
+  size_t right_pos = 0;
+  size_t common_length = 0;
+  while (true) {
+    while (true) {
+      while (left_pos < left.size() && IsND(left[left_pos])) left_pos++;
+      while (right_pos < right.size() && IsND(right[right_pos])) right_pos++;
+      if (left_pos == left.size() || right_pos == right.size() ||
+          left[left_pos] != right[right_pos])
+        break;
+      left_pos++;
+      right_pos++;
+      common_length++;
+    }
+    if (common_length >= ExecPathSignificantMax()) {
+      // PCIDs matched in earlier rounds may have been found ND since, so the
+      // prefix is recounted as pruned before stopping.
+      common_length = 0;
+      for (size_t i = 0; i < left_pos; i++)
+        if (!IsND(left[i])) common_length++;
+      if (common_length >= ExecPathSignificantMax()) break;
+    }
+    if (left_pos == left.size() && right_pos == right.size()) break;
 
+    CollectChunk(left, left_pos, diff_left, CheckDiffChunkSize() + 1);
+    CollectChunk(right, right_pos, diff_right, CheckDiffChunkSize() + 1);
+    bool is_last_iter = diff_left.size() <= CheckDiffChunkSize() ||
+                        diff_right.size() <= CheckDiffChunkSize();
     if (is_last_iter) {
-      left_chunk_size = left_pruned.size();
-      left_chunk = left_pruned;
-      right_chunk_size = right_pruned.size();
-      right_chunk = right_pruned;
+      CollectChunk(left, left_pos, diff_left, SIZE_MAX);
+      CollectChunk(right, right_pos, diff_right, SIZE_MAX);
     } else {
-      left_chunk_size = CheckDiffChunkSize();
-      left_chunk = subvec(left_pruned, 0, left_chunk_size);
-      right_chunk_size = CheckDiffChunkSize();
-      right_chunk = subvec(right_pruned, 0, right_chunk_size);
+      diff_left.resize(CheckDiffChunkSize());
+      diff_right.resize(CheckDiffChunkSize());
     }
 
-    shadow_left = std::vector<bool>(left_chunk_size, false);
-    shadow_right = std::vector<bool>(right_chunk_size, false);
+    size_t max = diff_left.size() + diff_right.size();
+    if (diff_forward.size() < 2 * max + 3) {
+      diff_forward.resize(2 * max + 3);
+      diff_backward.resize(2 * max + 3);
+    }
+    diff_shadow_left.assign(diff_left.size(), false);
+    diff_shadow_right.assign(diff_right.size(), false);
+
+    if (patience_diff)
+      PatienceDiff(diff_left, 0, diff_left.size(), diff_right, 0,
+                   diff_right.size(), diff_shadow_left, diff_shadow_right);
+    else
+      MyersDiff(diff_left, 0, diff_left.size(), diff_right, 0,
+                diff_right.size(), diff_shadow_left, diff_shadow_right);
+    AddND(diff_left, diff_shadow_left, is_last_iter);
+    AddND(diff_right, diff_shadow_right, is_last_iter);
   }
 }
 
@@ -421,6 +921,7 @@ ATTRIBUTE_INTERFACE
 ATTRIBUTE_NO_SANITIZE_ALL
 void __sanitizer_cov_trace_pc_guard(uint32_t* Guard) {
   pathfinder::PCID pcid = *Guard;
+  if (pcid == 0) return;
   pathfinder::TPC().AppendPathLog(pcid);
 }
 
@@ -429,4 +930,57 @@ void __sanitizer_cov_trace_pc_guard_init(uint32_t* Start, uint32_t* Stop) {
   pathfinder::TPC().HandleInit(Start, Stop);
 }
 
+// Constant operands of comparisons (`-fsanitize-coverage=trace-cmp`) are
+// collected as literals for synthesis. Comparisons of two variables are
+// ignored, but should be defined as well.
+ATTRIBUTE_INTERFACE
+void __sanitizer_cov_trace_cmp1(uint8_t, uint8_t) {}
+
+ATTRIBUTE_INTERFACE
+void __sanitizer_cov_trace_cmp2(uint16_t, uint16_t) {}
+
+ATTRIBUTE_INTERFACE
+void __sanitizer_cov_trace_cmp4(uint32_t, uint32_t) {}
+
+ATTRIBUTE_INTERFACE
+void __sanitizer_cov_trace_cmp8(uint64_t, uint64_t) {}
+
+ATTRIBUTE_INTERFACE
+ATTRIBUTE_NO_SANITIZE_ALL
+void __sanitizer_cov_trace_const_cmp1(uint8_t Arg1, uint8_t) {
+  pathfinder::TPC().HandleConstCmp(Arg1, 1);
+}
+
+ATTRIBUTE_INTERFACE
+ATTRIBUTE_NO_SANITIZE_ALL
+void __sanitizer_cov_trace_const_cmp2(uint16_t Arg1, uint16_t) {
+  pathfinder::TPC().HandleConstCmp(Arg1, 2);
+}
+
+ATTRIBUTE_INTERFACE
+ATTRIBUTE_NO_SANITIZE_ALL
+void __sanitizer_cov_trace_const_cmp4(uint32_t Arg1, uint32_t) {
+  pathfinder::TPC().HandleConstCmp(Arg1, 4);
+}
+
+ATTRIBUTE_INTERFACE
+ATTRIBUTE_NO_SANITIZE_ALL
+void __sanitizer_cov_trace_const_cmp8(uint64_t Arg1, uint64_t) {
+  pathfinder::TPC().HandleConstCmp(Arg1, 8);
+}
+
+ATTRIBUTE_INTERFACE
+ATTRIBUTE_NO_SANITIZE_ALL
+void __sanitizer_cov_trace_switch(uint64_t, uint64_t* Cases) {
+  // Cases[0] is the number of cases and Cases[1] is the bit width of the value.
+  for (uint64_t i = 0; i < Cases[0]; i++)
+    pathfinder::TPC().HandleConstCmp(Cases[2 + i], Cases[1] / 8);
+}
+
+ATTRIBUTE_INTERFACE
+void __sanitizer_cov_pcs_init(const uintptr_t* PCsBeg,
+                              const uintptr_t* PCsEnd) {
+  pathfinder::TPC().HandlePCsInit(PCsBeg, PCsEnd);
+}
+
 }  // extern "C"
@@ -3,7 +3,10 @@
 #include <stdint.h>
 
 #include "exectree.h"
+#include "input_store.h"
 #include "pathfinder.h"
+#include "scheduler.h"
+#include "snapshot.h"
 #include "test_utils.h"
 
 namespace pathfinder {
@@ -22,107 +25,227 @@ class ActTest : public testing::Test {
 
 TEST_F(ActTest, Init) { ASSERT_TRUE(act_target->is_empty()); }
 
+TEST_F(ActTest, InputInterning) {
+  size_t num_stored = input_store().size();
+  {
+    Input input1({{"a", 1}}, {{"x", 2}});
+    Input input2({{"a", 1}}, {{"x", 2}});
+    Input input3({{"a", 1}}, {{"x", 3}});
+    EXPECT_EQ(input1, input2);
+    EXPECT_NE(input1, input3);
+    EXPECT_EQ(input2["x"], 2);
+    EXPECT_EQ(input_store().size(), num_stored + 2);
+
+    act_target->insert(ExecPath{0x01}, input1, true);
+    act_target->insert(ExecPath{0x02}, input3, true);
+    EXPECT_TRUE(act_target->has(input2));
+  }
+  act_target = nullptr;
+  EXPECT_EQ(input_store().size(), num_stored);
+}
+
 TEST_F(ActTest, InsertionCase1) {
-  act_target->insert({0x01}, Input(), true);
+  act_target->insert(ExecPath{0x01}, Input(), true);
   EXPECT_EQ(act_target->get_leaves().size(), 1);
 }
 
 TEST_F(ActTest, InsertionCase2) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
   EXPECT_EQ(act_target->get_leaves().size(), 2);
 }
 
 TEST_F(ActTest, InsertionCase2Epsilon) {
-  act_target->insert({0x01}, Input(), true);
-  act_target->insert({0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01}, Input(), true);
+  act_target->insert(ExecPath{0x02}, Input(), true);
   EXPECT_EQ(act_target->get_leaves().size(), 2);
   EXPECT_EQ(act_target->get_root()->get_prefix(), Node::EPSILON);
 }
 
 TEST_F(ActTest, InsertionCase2Epsilon2) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01}, Input(), true);
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x00}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x00}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct));
 }
 
 TEST_F(ActTest, InsertionCase3) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03}, Input(), true);
-  act_target->insert({0x01}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01}, Input(), true);
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x00}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x00}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct));
 }
 
 TEST_F(ActTest, InsertionCase4) {
-  act_target->insert({0x01}, Input(), true);
-  act_target->insert({0x01}, Input(), true);
+  act_target->insert(ExecPath{0x01}, Input(), true);
+  act_target->insert(ExecPath{0x01}, Input(), true);
   EXPECT_EQ(act_target->get_leaves().size(), 1);
 }
 
 TEST_F(ActTest, InsertionCase5) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x04}, Input(), true);
 
   EXPECT_EQ(act_target->get_leaves().size(), 3);
 }
 
 TEST_F(ActTest, InsertionCase6) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x03, 0x05}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x05}, Input(), true);
 
   EXPECT_EQ(act_target->get_leaves().size(), 3);
 }
 
 TEST_F(ActTest, InsertionCase6Epsilon) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
 
   EXPECT_EQ(act_target->get_leaves().size(), 3);
 }
 
 TEST_F(ActTest, InsertionCase7) {
-  act_target->insert({0x01}, Input(), true);
-  act_target->insert({0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
 
-  act_correct->insert({0x01, 0x00}, Input(), true);
-  act_correct->insert({0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x00}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct));
 }
 
 TEST_F(ActTest, Find) {
-  act_target->insert({0x01}, Input(), true);
-  Node* inserted = act_target->insert({0x02}, Input(), true);
-  Node* found = act_target->find({0x02});
+  act_target->insert(ExecPath{0x01}, Input(), true);
+  Node* inserted = act_target->insert(ExecPath{0x02}, Input(), true);
+  Node* found = act_target->find(ExecPath{0x02});
   EXPECT_EQ(inserted, found) << "====== target ======\n"
                              << act_target->to_string(true);
 }
 
+TEST_F(ActTest, Has) {
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
+  EXPECT_TRUE(act_target->has(ExecPath{0x01, 0x02}));
+  EXPECT_TRUE(act_target->has(ExecPath{0x01, 0x03}));
+  EXPECT_FALSE(act_target->has(ExecPath{0x01}));
+  EXPECT_FALSE(act_target->has(ExecPath{0x01, 0x02, 0x03}));
+}
+
 TEST_F(ActTest, PurgeAndReinsert) {
-  act_target->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x02, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x05, 0x06}, Input(), true);
-  act_target->purge_and_reinsert({0x01, 0x05, 0x06}, {0x01, 0x02, 0x07});
+  act_target->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x05, 0x06}, Input(), true);
+  act_target->purge_and_reinsert(ExecPath{0x01, 0x05, 0x06},
+                                 ExecPath{0x01, 0x02, 0x07});
 
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x07}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x07}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct));
 }
 
+TEST_F(ActTest, PathCond) {
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  Node* leaf = act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
+  auto path_cond = leaf->get_path_cond();
+  EXPECT_EQ(path_cond.first.size() + path_cond.second.size(), 1);
+
+  act_target->insert(ExecPath{0x01, 0x03, 0x04}, Input(), true);
+  path_cond = leaf->get_path_cond();
+  EXPECT_EQ(path_cond.first.size() + path_cond.second.size(), 2);
+}
+
+TEST_F(ActTest, PathCondInvalidation) {
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x05}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
+  std::vector<Node*> nodes = act_target->get_nodes(ExecPath{0x01, 0x03, 0x04});
+  Node* internal = nodes[nodes.size() - 2];
+  Node* leaf = nodes.back();
+  Node* epsilon_leaf = act_target->get_nodes(ExecPath{0x01, 0x03}).back();
+  ASSERT_EQ(epsilon_leaf->get_prefix(), Node::EPSILON);
+
+  auto has_cond = [](Node* node, NumericCondition* cond) {
+    auto path_cond = node->get_path_cond();
+    return std::count(path_cond.second.begin(), path_cond.second.end(),
+                      cond) > 0;
+  };
+  auto replace_cond = [](Node* node) {
+    auto cond = std::make_unique<NumericCondition>();
+    NumericCondition* cond_raw = cond.get();
+    node->set_cond(std::move(cond));
+    return cond_raw;
+  };
+
+  // Cached conditions of the nodes below, and of the parent of an epsilon
+  // child, see a replaced condition.
+  leaf->get_path_cond();
+  NumericCondition* internal_cond = replace_cond(internal);
+  EXPECT_TRUE(has_cond(leaf, internal_cond));
+  EXPECT_TRUE(has_cond(internal, internal_cond));
+  NumericCondition* epsilon_cond = replace_cond(epsilon_leaf);
+  EXPECT_TRUE(has_cond(internal, epsilon_cond));
+  EXPECT_FALSE(has_cond(leaf, epsilon_cond));
+}
+
+TEST_F(ActTest, SubtreeAggregates) {
+  act_target->insert(ExecPath{0x01, 0x02, 0x03}, Input({}, {{"x", 1}}), true);
+  act_target->insert(ExecPath{0x01, 0x02, 0x04}, Input({}, {{"x", 2}}), true);
+  Node* root = act_target->get_root();
+  EXPECT_EQ(root->get_height(), 1);
+  EXPECT_EQ(root->get_num_leaves(), 2);
+  EXPECT_EQ(root->get_num_inputs(), 2);
+
+  Node* leaf =
+      act_target->insert(ExecPath{0x01, 0x05}, Input({}, {{"x", 3}}), true);
+  act_target->insert(ExecPath{0x01, 0x05}, Input({}, {{"x", 4}}), true);
+  root = act_target->get_root();
+  EXPECT_EQ(leaf->get_depth(), 1);
+  EXPECT_EQ(root->get_height(), 2);
+  EXPECT_EQ(root->get_num_leaves(), 3);
+  EXPECT_EQ(root->get_num_inputs(), 4);
+}
+
+TEST_F(ActTest, BulkInsert) {
+  std::vector<ExecPath> epaths = {{0x01, 0x02, 0x03}, {0x01, 0x02},
+                                  {0x04},             {0x01, 0x02, 0x05, 0x06},
+                                  {0x01, 0x07},       {0x04, 0x08},
+                                  {0x01, 0x02, 0x03}};
+  for (PCID i = 0; i < 20; i++) epaths.push_back({0x09, 0x10 + i});
+  ExecPath long_epath = {0x01};
+  long_epath.resize(1200, 0x0A);
+  epaths.push_back(long_epath);
+
+  std::vector<PathEntry> entries;
+  for (size_t i = 0; i < epaths.size(); i++) {
+    Input input({}, {{"x", (long)i}});
+    act_correct->insert(epaths[i], input, true);
+    entries.push_back({epaths[i], {input}, true});
+  }
+  act_target->bulk_insert(entries);
+
+  for (auto& epath : epaths) EXPECT_TRUE(act_target->has(epath));
+  EXPECT_EQ(act_target->get_leaves().size(), act_correct->get_leaves().size());
+  EXPECT_EQ(act_target->num_total_input(), act_correct->num_total_input());
+  EXPECT_TRUE(act_target->is_sorted());
+  EXPECT_TRUE(struct_eq(*act_target, *act_correct))
+      << "====== target ======\n"
+      << act_target->to_string(true) << "====== correct ======\n"
+      << act_correct->to_string(true);
+}
+
 class NdPruningTest : public testing::Test {
  protected:
   NdPruningTest() {
@@ -136,11 +259,11 @@ class NdPruningTest : public testing::Test {
 };
 
 TEST_F(NdPruningTest, FilterND1) {
-  Node* inserted = act_target->insert({0x01, 0x02}, Input(), true);
+  Node* inserted = act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
   mock_tpc->AddND({0x02});
   act_target->prune();
 
-  act_correct->insert({0x01}, Input(), true);
+  act_correct->insert(ExecPath{0x01}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -149,13 +272,13 @@ TEST_F(NdPruningTest, FilterND1) {
 }
 
 TEST_F(NdPruningTest, FilterND2) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
   mock_tpc->AddND({0x02});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x00}, Input(), true);
-  act_correct->insert({0x01, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x00}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x03}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -164,13 +287,13 @@ TEST_F(NdPruningTest, FilterND2) {
 }
 
 TEST_F(NdPruningTest, FilterND3) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03}, Input(), true);
   mock_tpc->AddND({0x01});
   act_target->prune();
 
-  act_correct->insert({0x02}, Input(), true);
-  act_correct->insert({0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x03}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -179,15 +302,15 @@ TEST_F(NdPruningTest, FilterND3) {
 }
 
 TEST_F(NdPruningTest, RmEmptyPrefixedInternalNode1) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x03, 0x05}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x05}, Input(), true);
   mock_tpc->AddND({0x03});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x05}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x05}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -196,17 +319,17 @@ TEST_F(NdPruningTest, RmEmptyPrefixedInternalNode1) {
 }
 
 TEST_F(NdPruningTest, RmEmptyPrefixedInternalNode2) {
-  act_target->insert({0x01, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x03, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x03, 0x05, 0x06}, Input(), true);
-  act_target->insert({0x01, 0x03, 0x05, 0x07}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x05, 0x06}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x03, 0x05, 0x07}, Input(), true);
   mock_tpc->AddND({0x03, 0x05});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x06}, Input(), true);
-  act_correct->insert({0x01, 0x07}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x06}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x07}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -215,14 +338,14 @@ TEST_F(NdPruningTest, RmEmptyPrefixedInternalNode2) {
 }
 
 TEST_F(NdPruningTest, Merge1) {
-  act_target->insert({0x01, 0x0A, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02}, Input(), true);
-  act_target->insert({0x01, 0xC}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0xC}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -231,17 +354,17 @@ TEST_F(NdPruningTest, Merge1) {
 }
 
 TEST_F(NdPruningTest, Merge2) {
-  act_target->insert({0x01, 0x0A, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -250,16 +373,16 @@ TEST_F(NdPruningTest, Merge2) {
 }
 
 TEST_F(NdPruningTest, Merge2Epsilon) {
-  act_target->insert({0x01, 0x0A, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -268,17 +391,17 @@ TEST_F(NdPruningTest, Merge2Epsilon) {
 }
 
 TEST_F(NdPruningTest, Merge3) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0A, 0x02, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -287,16 +410,16 @@ TEST_F(NdPruningTest, Merge3) {
 }
 
 TEST_F(NdPruningTest, Merge3Epsilon) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0A, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -305,19 +428,19 @@ TEST_F(NdPruningTest, Merge3Epsilon) {
 }
 
 TEST_F(NdPruningTest, Merge4) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0A, 0x02, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x05}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x06}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x05}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x06}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x05}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x06}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x05}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x06}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -326,15 +449,15 @@ TEST_F(NdPruningTest, Merge4) {
 }
 
 TEST_F(NdPruningTest, Merge5) {
-  act_target->insert({0x01, 0x0A, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -343,17 +466,17 @@ TEST_F(NdPruningTest, Merge5) {
 }
 
 TEST_F(NdPruningTest, Merge6) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0A, 0x02, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x05}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x05}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x05}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x05}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -362,15 +485,15 @@ TEST_F(NdPruningTest, Merge6) {
 }
 
 TEST_F(NdPruningTest, Merge7) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -379,17 +502,17 @@ TEST_F(NdPruningTest, Merge7) {
 }
 
 TEST_F(NdPruningTest, Merge8) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x05}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x05}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x05}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x05}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -398,15 +521,15 @@ TEST_F(NdPruningTest, Merge8) {
 }
 
 TEST_F(NdPruningTest, Merge9) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x04}, Input(), true);
-  act_target->insert({0x01, 0x0C}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0C}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x01, 0x02, 0x04}, Input(), true);
-  act_correct->insert({0x01, 0x0C}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x0C}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -415,12 +538,12 @@ TEST_F(NdPruningTest, Merge9) {
 }
 
 TEST_F(NdPruningTest, RmInternalWithOnlyChild1) {
-  act_target->insert({0x0A, 0x01}, Input(), true);
-  act_target->insert({0x0B, 0x01}, Input(), true);
+  act_target->insert(ExecPath{0x0A, 0x01}, Input(), true);
+  act_target->insert(ExecPath{0x0B, 0x01}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01}, Input(), true);
+  act_correct->insert(ExecPath{0x01}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -429,12 +552,12 @@ TEST_F(NdPruningTest, RmInternalWithOnlyChild1) {
 }
 
 TEST_F(NdPruningTest, RmInternalWithOnlyChild2) {
-  act_target->insert({0x01, 0x0A, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -443,14 +566,14 @@ TEST_F(NdPruningTest, RmInternalWithOnlyChild2) {
 }
 
 TEST_F(NdPruningTest, RmInternalWithOnlyChild3) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x0C, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0A, 0x02, 0x0D, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x0C, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x0D, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x0C, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x0D, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x0C, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x0D, 0x03}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B, 0x0C, 0x0D});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -459,16 +582,16 @@ TEST_F(NdPruningTest, RmInternalWithOnlyChild3) {
 }
 
 TEST_F(NdPruningTest, RmInternalWithOnlyChild4) {
-  act_target->insert({0x01, 0x0A, 0x02, 0x0C, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0A, 0x02, 0x0D, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x0C, 0x03}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02, 0x0D, 0x03}, Input(), true);
-  act_target->insert({0x0E}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x0C, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A, 0x02, 0x0D, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x0C, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02, 0x0D, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x0E}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B, 0x0C, 0x0D});
   act_target->prune();
 
-  act_correct->insert({0x01, 0x02, 0x03}, Input(), true);
-  act_correct->insert({0x0E}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x0E}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -477,15 +600,15 @@ TEST_F(NdPruningTest, RmInternalWithOnlyChild4) {
 }
 
 TEST_F(NdPruningTest, PullNode) {
-  act_target->insert({0x01, 0x0A}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x02}, Input(), true);
-  act_target->insert({0x01, 0x0B, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0A}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x02}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x0B, 0x03}, Input(), true);
   mock_tpc->AddND({0x0A, 0x0B});
   act_target->prune();
 
-  act_correct->insert({0x01}, Input(), true);
-  act_correct->insert({0x01, 0x02}, Input(), true);
-  act_correct->insert({0x01, 0x03}, Input(), true);
+  act_correct->insert(ExecPath{0x01}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x03}, Input(), true);
 
   EXPECT_TRUE(struct_eq(*act_target, *act_correct))
       << "====== target ======\n"
@@ -523,4 +646,320 @@ TEST_F(NdPruningTest, TailExecPath3) {
   EXPECT_FALSE(act_target->has(_997_As));
 }
 
+TEST_F(NdPruningTest, PruneIncrementally) {
+  act_target->insert(ExecPath{0x01, 0x02, 0x03, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02, 0x05, 0x06}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x07, 0x03, 0x04}, Input(), true);
+
+  mock_tpc->AddND({0x02});
+  act_target->prune();
+  mock_tpc->AddND({0x07});
+  act_target->prune();
+  act_target->prune();
+
+  act_correct->insert(ExecPath{0x01, 0x03, 0x04}, Input(), true);
+  act_correct->insert(ExecPath{0x01, 0x05, 0x06}, Input(), true);
+
+  EXPECT_TRUE(act_target->has(ExecPath{0x01, 0x03, 0x04}));
+  EXPECT_TRUE(struct_eq(*act_target, *act_correct))
+      << "====== target ======\n"
+      << act_target->to_string(true) << "====== correct ======\n"
+      << act_correct->to_string(true);
+}
+
+TEST_F(NdPruningTest, PrefixPoolCompaction) {
+  std::vector<ExecPath> epaths;
+  for (PCID i = 0; i < 64; i++) {
+    ExecPath epath = {0x01, 0x0F};
+    for (size_t j = 0; j < 500; j++) epath.push_back(0x10 + (i * j) % 80);
+    epaths.push_back(epath);
+    act_target->insert(epath, Input(), true);
+  }
+
+  mock_tpc->AddND({0x0F});
+  act_target->prune();
+  for (size_t i = 0; i < epaths.size(); i++) {
+    ExecPath pruned = epaths[i];
+    pruned.erase(pruned.begin() + 1);
+    act_correct->insert(pruned, Input(), true);
+    EXPECT_TRUE(act_target->has(pruned));
+  }
+  EXPECT_TRUE(act_target->is_sorted());
+  EXPECT_TRUE(struct_eq(*act_target, *act_correct));
+}
+
+TEST_F(NdPruningTest, WideFanOut) {
+  std::vector<PCID> pcids;
+  for (PCID i = 0; i < 80; i++) pcids.push_back(0x10 + i);
+  std::shuffle(pcids.begin(), pcids.end(), std::mt19937(0));
+
+  ExecPath nd_pcids;
+  for (auto pcid : pcids) {
+    PCID even = pcid - pcid % 2;
+    act_target->insert(ExecPath{0x01, pcid, even}, Input(), true);
+    if (pcid % 2 == 1) nd_pcids.push_back(pcid);
+  }
+  for (auto pcid : pcids)
+    EXPECT_TRUE(act_target->has(ExecPath{0x01, pcid, pcid - pcid % 2}));
+
+  mock_tpc->AddND(nd_pcids);
+  act_target->prune();
+  for (PCID i = 0; i < 80; i += 2) {
+    act_correct->insert(ExecPath{0x01, 0x10 + i, 0x10 + i}, Input(), true);
+    act_correct->insert(ExecPath{0x01, 0x10 + i}, Input(), true);
+  }
+
+  EXPECT_TRUE(act_target->is_sorted());
+  EXPECT_TRUE(struct_eq(*act_target, *act_correct))
+      << "====== target ======\n"
+      << act_target->to_string(true) << "====== correct ======\n"
+      << act_correct->to_string(true);
+}
+
+TEST_F(NdPruningTest, SnapshotRoundTrip) {
+  act_target->insert(ExecPath{0x01, 0x02, 0x03, 0x04}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x02, 0x05, 0x06}, Input(), true);
+  act_target->insert(ExecPath{0x01, 0x07, 0x03}, Input(), true);
+  act_target->insert(ExecPath{0x08}, Input(), true);
+  mock_tpc->AddND({0x02});
+  act_target->prune();
+
+  std::string filename = "/tmp/pathfinder_act_test.snapshot";
+  Snapshot::save(filename, *act_target, mock_tpc.get());
+
+  MockTracePC resumed_tpc;
+  ExecTree resumed(resumed_tpc.get());
+  Snapshot::load(filename, resumed, resumed_tpc.get());
+  fs::remove(filename);
+
+  EXPECT_EQ(resumed_tpc->GetNumND(), 1);
+  EXPECT_EQ(resumed.get_leaves().size(), act_target->get_leaves().size());
+  EXPECT_TRUE(resumed.has(ExecPath{0x01, 0x03, 0x04}));
+  EXPECT_TRUE(resumed.has(ExecPath{0x01, 0x07, 0x03}));
+  EXPECT_TRUE(resumed.is_sorted());
+  EXPECT_TRUE(struct_eq(resumed, *act_target))
+      << "====== resumed ======\n"
+      << resumed.to_string(true) << "====== saved ======\n"
+      << act_target->to_string(true);
+}
+
+TEST(MemoryBudgetTest, SpillColdLeaves) {
+  MockTracePC mock_tpc;
+  ExecTree act_target(mock_tpc.get());
+  MEMORY_BUDGET = 1;
+
+  // Tails of 4KB each, 2MB in total.
+  std::vector<ExecPath> epaths;
+  for (PCID i = 0; i < 512; i++) {
+    ExecPath epath = {0x01, 0x10 + i / 32, 0x20 + i % 32};
+    while (epath.size() < 1000) epath.push_back(0x04);
+    for (size_t j = 0; j < 1000; j++) epath.push_back(0x40 + (i + j) % 32);
+    epaths.push_back(epath);
+    act_target.insert(epath, Input(), true);
+  }
+
+  size_t num_spilled = 0;
+  for (auto& leaf : act_target.get_leaves())
+    if (leaf->is_spilled()) num_spilled++;
+  EXPECT_GT(num_spilled, 0);
+  for (auto& epath : epaths) EXPECT_TRUE(act_target.has(epath));
+
+  mock_tpc->AddND({0x40});
+  act_target.prune();
+  for (auto& leaf : act_target.get_leaves()) {
+    ExecPathView tail = leaf->get_tail();
+    EXPECT_EQ(std::count(tail.begin(), tail.end(), 0x40), 0);
+  }
+  EXPECT_TRUE(act_target.is_sorted());
+  // Inputs of leaves pulled while spilled are still found, and only once.
+  EXPECT_TRUE(act_target.has(Input()));
+  EXPECT_EQ(act_target.num_total_input(), 1);
+  MEMORY_BUDGET = 0;
+}
+
+TEST(SchedulerTest, WeightTree) {
+  WeightTree weights;
+  weights.resize(2);
+  weights.set(0, 1);
+  weights.resize(4);
+  weights.set(2, 2);
+  weights.set(3, 3);
+  EXPECT_DOUBLE_EQ(weights.total(), 6);
+  EXPECT_EQ(weights.find(0.5), 0);
+  EXPECT_EQ(weights.find(1), 2);
+  EXPECT_EQ(weights.find(2.9), 2);
+  EXPECT_EQ(weights.find(3), 3);
+  EXPECT_EQ(weights.find(5.9), 3);
+}
+
+TEST(SchedulerTest, RarityFavorsRarelyRunPaths) {
+  MockTracePC mock_tpc;
+  ExecTree act_target(mock_tpc.get());
+  Scheduler scheduler(&act_target);
+  SCHEDULING_STRATEGY = SCHEDULE_RARITY;
+
+  Node* often_run = act_target.insert(ExecPath{0x01, 0x02}, Input(), true);
+  Node* rarely_run = act_target.insert(ExecPath{0x01, 0x03}, Input(), true);
+  scheduler.schedule();
+  for (size_t i = 0; i < 1000; i++) scheduler.report_hit(as_leaf(often_run));
+
+  size_t num_rarely_run = 0;
+  for (size_t i = 0; i < 100; i++)
+    if (scheduler.schedule() == rarely_run) num_rarely_run++;
+  EXPECT_GT(num_rarely_run, 90);
+  SCHEDULING_STRATEGY = SCHEDULE_RAND;
+}
+
+TEST(SchedulerTest, CostFavorsCheapPaths) {
+  MockTracePC mock_tpc;
+  ExecTree act_target(mock_tpc.get());
+  Scheduler scheduler(&act_target);
+  SCHEDULING_STRATEGY = SCHEDULE_COST;
+
+  Node* expensive = act_target.insert(ExecPath{0x01, 0x02}, Input(), true);
+  Node* cheap = act_target.insert(ExecPath{0x01, 0x03}, Input(), true);
+  scheduler.schedule();
+  scheduler.report_run(as_leaf(expensive), 100000000, 2);
+  scheduler.report_run(as_leaf(cheap), 100000, 2);
+  EXPECT_EQ(as_leaf(cheap)->get_num_runs(), 1);
+  EXPECT_EQ(as_leaf(cheap)->get_latency(), 100000);
+
+  size_t num_cheap = 0;
+  for (size_t i = 0; i < 100; i++)
+    if (scheduler.schedule() == cheap) num_cheap++;
+  EXPECT_GT(num_cheap, 90);
+  SCHEDULING_STRATEGY = SCHEDULE_RAND;
+}
+
+TEST(SchedulerTest, QuarantineInfeasibleLeaves) {
+  MockTracePC mock_tpc;
+  ExecTree act_target(mock_tpc.get());
+  Scheduler scheduler(&act_target);
+
+  Node* infeasible = act_target.insert(ExecPath{0x01, 0x02}, Input(), true);
+  act_target.insert(ExecPath{0x01, 0x03}, Input(), true);
+  size_t num_infeasible = 0;
+  for (size_t i = 0; i < 200; i++) {
+    if (scheduler.schedule() != infeasible) continue;
+    num_infeasible++;
+    scheduler.report_failure();
+  }
+  EXPECT_LT(num_infeasible, 30);
+
+  // Released by a new condition on its path.
+  infeasible->set_cond(default_branch_condition());
+  num_infeasible = 0;
+  for (size_t i = 0; i < 20; i++)
+    if (scheduler.schedule() == infeasible) num_infeasible++;
+  EXPECT_GT(num_infeasible, 0);
+}
+
+// Tests below run last, as registering a parameter changes how inputs
+// serialize.
+static void register_x() {
+  static IntArg x = PathFinderIntArg("x");
+  (void)x;
+}
+
+TEST(MemoryBudgetTest, ReleaseSpilledInputs) {
+  register_x();
+  MockTracePC mock_tpc;
+  ExecTree act_target(mock_tpc.get());
+  MEMORY_BUDGET = 1;
+  size_t num_stored = input_store().size();
+
+  std::vector<ExecPath> epaths;
+  for (PCID i = 0; i < 512; i++) {
+    ExecPath epath = {0x01, 0x10 + i / 32, 0x20 + i % 32};
+    while (epath.size() < 2000) epath.push_back(0x04);
+    epaths.push_back(epath);
+    act_target.insert(epath, Input({}, {{"x", i}}), true);
+  }
+  size_t num_spilled = 0;
+  for (auto& leaf : act_target.get_leaves())
+    if (leaf->is_spilled()) num_spilled++;
+  EXPECT_GT(num_spilled, 0);
+  EXPECT_EQ(input_store().size(), num_stored + 512 - num_spilled);
+  EXPECT_EQ(act_target.num_total_input(), 512);
+
+  // Found by their arguments while spilled, and interned again once paged in
+  // by inserting them anew.
+  for (long i = 0; i < 512; i++) {
+    Input input({}, {{"x", i}});
+    ASSERT_TRUE(act_target.has(input));
+    EXPECT_EQ(act_target.get_path(input), epaths[i]);
+    act_target.insert(epaths[i], input, true);
+    EXPECT_EQ(act_target.get_leaf(input)->get_num_inputs(), 1);
+  }
+  EXPECT_FALSE(act_target.has(Input({}, {{"x", 512}})));
+  EXPECT_EQ(act_target.num_total_input(), 512);
+  MEMORY_BUDGET = 0;
+}
+
+TEST(MemoryBudgetTest, ReuseSpillRecords) {
+  register_x();
+  MockTracePC mock_tpc;
+  ExecTree act_target(mock_tpc.get());
+  MEMORY_BUDGET = 1;
+
+  std::vector<ExecPath> epaths;
+  for (PCID i = 0; i < 256; i++) {
+    ExecPath epath = {0x01, 0x10 + i / 32, 0x20 + i % 32};
+    while (epath.size() < 4000) epath.push_back(0x04);
+    epaths.push_back(epath);
+    act_target.insert(epath, Input({}, {{"x", i}}), true);
+  }
+
+  // Leaves are paged in and spilled again in turn, unchanged every other
+  // round, and with a new input otherwise.
+  size_t first_spilled_size = 0;
+  for (long round = 0; round < 20; round++) {
+    for (long i = 0; i < 256; i++)
+      act_target.insert(epaths[i], Input({}, {{"x", i + 256 * (round / 2)}}),
+                        true);
+    if (round == 1) first_spilled_size = act_target.spilled_size();
+  }
+  EXPECT_GT(first_spilled_size, 0);
+  EXPECT_LT(act_target.spilled_size(), 2 * first_spilled_size);
+  MEMORY_BUDGET = 0;
+}
+
+TEST(ReservoirTest, UniformSample) {
+  register_x();
+  MockTracePC mock_tpc;
+  ExecPath epath = {0x01, 0x02};
+  size_t max_inputs = Node::MAX_INPUT_PER_PATH;
+
+  // Each input is equally likely to be kept, however late it is inserted.
+  size_t num_kept[4] = {};
+  for (size_t trial = 0; trial < 20; trial++) {
+    ExecTree act_target(mock_tpc.get());
+    for (long i = 0; i < 2000; i++)
+      act_target.insert(epath, Input({}, {{"x", i}}), true);
+    EXPECT_EQ(act_target.get_leaves()[0]->get_num_inputs(), max_inputs);
+    for (long i = 0; i < 2000; i++)
+      if (act_target.has(Input({}, {{"x", i}}))) num_kept[i / 500]++;
+  }
+  for (size_t quarter = 0; quarter < 4; quarter++) {
+    EXPECT_GT(num_kept[quarter], 400);
+    EXPECT_LT(num_kept[quarter], 600);
+  }
+}
+
+TEST(ReservoirTest, KeepCounterexample) {
+  register_x();
+  MockTracePC mock_tpc;
+  ExecTree act_target(mock_tpc.get());
+  ExecPath epath = {0x01, 0x02};
+  size_t max_inputs = Node::MAX_INPUT_PER_PATH;
+  for (long i = 0; i < 2000; i++)
+    act_target.insert(epath, Input({}, {{"x", i}}), true);
+
+  for (long i = 2000; i < 2100; i++) {
+    act_target.insert(epath, Input({}, {{"x", i}}), true, true);
+    EXPECT_TRUE(act_target.has(Input({}, {{"x", i}})));
+  }
+  EXPECT_EQ(act_target.get_leaves()[0]->get_num_inputs(), max_inputs);
+}
+
 }  // namespace pathfinder
@@ -0,0 +1,31 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "fork_server.h"
+#include "pathfinder.h"
+#include "test_utils.h"
+
+namespace pathfinder {
+
+static int callback(const Input& input) {
+  auto it = input.get_numeric_args().find("action");
+  long action = it == input.get_numeric_args().end() ? 0 : it->second;
+  if (action == 1) abort();
+  if (action == 2) sleep(10);
+  return (int)action;
+}
+
+static Input action(long value) { return Input({}, {{"action", value}}); }
+
+TEST(ForkServerTest, SurvivesCrashesAndHangs) {
+  ForkServer fork_server(callback, nullptr);
+  // The first input is run in-process.
+  EXPECT_EQ(fork_server.run(Input(), 1), 0);
+
+  EXPECT_EQ(fork_server.run(action(1), 1), PATHFINDER_CRASH);
+  EXPECT_EQ(fork_server.run(action(2), 1), PATHFINDER_TIMEOUT);
+  EXPECT_EQ(fork_server.run(action(PATHFINDER_PASS), 1), PATHFINDER_PASS);
+  EXPECT_EQ(fork_server.run(action(0), 0), 0);
+}
+
+}  // namespace pathfinder
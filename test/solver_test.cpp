@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include "input_generator.h"
+#include "pathfinder.h"
+#include "test_utils.h"
+
+namespace pathfinder {
+
+class SolverTest : public testing::Test {
+ protected:
+  SolverTest() {
+    // The input signature is global, so `x` is registered once for all tests.
+    static IntArg registered = PathFinderIntArg("x");
+    x = registered;
+    ig = std::make_unique<InputGenerator>();
+  }
+
+  std::unique_ptr<NumericCondition> numeric_condition(BoolExpr cond) {
+    return std::make_unique<NumericCondition>(
+        std::make_unique<BoolExpr>(cond));
+  }
+  size_t num_guards(const NumericSolver& solver) {
+    return solver.guards.size();
+  }
+
+  IntArg x;
+  std::unique_ptr<InputGenerator> ig;
+};
+
+TEST_F(SolverTest, GenerationalRetriesExhaustedBatch) {
+  auto lt_zero = numeric_condition(IntExpr("x") < 0);
+  auto lt_minus_four = numeric_condition(IntExpr("x") < -4);
+  ig->set_flips(
+      {Flip{lt_zero.get()}, Flip{lt_minus_four.get(), nullptr, true}});
+
+  // Only four inputs leave the path, and each batch draws one of them.
+  std::set<long> drawn;
+  for (size_t i = 0; i < 12; i++) {
+    std::optional<Input> input = ig->gen();
+    ASSERT_TRUE(input.has_value());
+    EXPECT_LE(-4, input.value()[x]);
+    EXPECT_LT(input.value()[x], 0);
+    if (i < 4) {
+      EXPECT_TRUE(drawn.insert(input.value()[x]).second);
+    }
+  }
+  EXPECT_FALSE(ig->is_unsat());
+}
+
+TEST_F(SolverTest, GenerationalUnsat) {
+  auto lt_zero = numeric_condition(IntExpr("x") < 0);
+  auto lt_four = numeric_condition(IntExpr("x") < 4);
+  ig->set_flips({Flip{lt_zero.get()}, Flip{lt_four.get(), nullptr, true}});
+
+  EXPECT_FALSE(ig->gen().has_value());
+  EXPECT_TRUE(ig->is_unsat());
+}
+
+TEST_F(SolverTest, GuardsSharedAcrossPaths) {
+  NumericSolver solver;
+  auto lt_zero = numeric_condition(IntExpr("x") < 0);
+  auto gt_minus_four = numeric_condition(IntExpr("x") > -4);
+
+  solver.set_condition({lt_zero.get()}, true);
+  std::optional<Args> args = solver.draw();
+  ASSERT_TRUE(args.has_value());
+  EXPECT_LT(args.value()["x"], 0);
+
+  solver.set_condition({lt_zero.get(), gt_minus_four.get()}, true);
+  args = solver.draw();
+  ASSERT_TRUE(args.has_value());
+  EXPECT_LT(-4, args.value()["x"]);
+  EXPECT_LT(args.value()["x"], 0);
+  EXPECT_EQ(num_guards(solver), 2);
+
+  // Guards of conditions left out are no longer assumed.
+  solver.set_condition({gt_minus_four.get()}, true);
+  bool left_lt_zero = false;
+  for (size_t i = 0; i < 4; i++) {
+    args = solver.draw();
+    ASSERT_TRUE(args.has_value());
+    EXPECT_LT(-4, args.value()["x"]);
+    left_lt_zero |= args.value()["x"] >= 0;
+  }
+  EXPECT_TRUE(left_lt_zero);
+  EXPECT_EQ(num_guards(solver), 2);
+}
+
+TEST_F(SolverTest, NegatedGuard) {
+  NumericSolver solver;
+  auto lt_zero = numeric_condition(IntExpr("x") < 0);
+  auto lt_four = numeric_condition(IntExpr("x") < 4);
+  solver.set_condition({}, true);
+
+  // Only four inputs leave the path, as the negated guard of `lt_zero` must
+  // negate the condition itself.
+  std::vector<Flip> path{Flip{lt_four.get()},
+                         Flip{lt_zero.get(), nullptr, true}};
+  for (size_t i = 0; i < 4; i++) {
+    std::vector<std::optional<Args>> args = solver.draw_flips(path);
+    EXPECT_FALSE(args[0].has_value());
+    ASSERT_TRUE(args[1].has_value());
+    EXPECT_LE(0, args[1].value()["x"]);
+    EXPECT_LT(args[1].value()["x"], 4);
+  }
+  EXPECT_FALSE(solver.draw_flips(path)[1].has_value());
+}
+
+TEST_F(SolverTest, GuardsResetAtMax) {
+  NumericSolver solver;
+  std::vector<std::unique_ptr<NumericCondition>> conds;
+  for (size_t i = 0; i < NumericSolver::MAX_GUARDS; i++) {
+    conds.push_back(numeric_condition(IntExpr("x") < (int)i));
+    solver.set_condition({conds.back().get()}, true);
+  }
+  EXPECT_EQ(num_guards(solver), NumericSolver::MAX_GUARDS);
+
+  auto gt_zero = numeric_condition(IntExpr("x") > 0);
+  solver.set_condition({gt_zero.get()}, true);
+  EXPECT_EQ(num_guards(solver), 1);
+  std::optional<Args> args = solver.draw();
+  ASSERT_TRUE(args.has_value());
+  EXPECT_GT(args.value()["x"], 0);
+}
+
+}  // namespace pathfinder
@@ -21,6 +21,7 @@ class MockTracePC {
   }
   TracePC* operator->() { return tpc.get(); }
   TracePC* get() { return tpc.get(); }
+  uint32_t* get_guard() { return guard; }
 
  private:
   uint32_t* guard = nullptr;
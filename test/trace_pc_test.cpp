@@ -34,6 +34,77 @@ TEST_F(TracePCTest, Trace2) {
   EXPECT_EQ(epath, ExecPath());
 }
 
+TEST_F(TracePCTest, NewCovered) {
+  mock_tpc->TraceOn();
+  mock_tpc->AppendPathLog(0x01);
+  mock_tpc->AppendPathLog(0x02);
+  mock_tpc->AppendPathLog(0x01);
+  EXPECT_EQ(mock_tpc->GetNewCovered().to_vec(), ExecPath({0x01, 0x02}));
+
+  mock_tpc->ClearPathLog();
+  mock_tpc->AppendPathLog(0x02);
+  mock_tpc->AppendPathLog(0x03);
+  EXPECT_EQ(mock_tpc->GetNewCovered().to_vec(), ExecPath({0x03}));
+  EXPECT_EQ(mock_tpc->GetNumCovered(), 3);
+}
+
+TEST_F(TracePCTest, NewCoveredByThreads) {
+  mock_tpc->SetThreadPolicy(THREAD_MERGE);
+  mock_tpc->TraceOn();
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < 4; i++)
+    workers.emplace_back([this]() {
+      for (PCID pcid = 1; pcid <= 100; pcid++) mock_tpc->AppendPathLog(pcid);
+    });
+  for (auto& worker : workers) worker.join();
+  mock_tpc->TraceOff();
+
+  // Each PC is recorded once, by whichever thread covered it first.
+  ExecPath new_covered = mock_tpc->GetNewCovered().to_vec();
+  std::sort(new_covered.begin(), new_covered.end());
+  ExecPath expected;
+  for (PCID pcid = 1; pcid <= 100; pcid++) expected.push_back(pcid);
+  EXPECT_EQ(new_covered, expected);
+  EXPECT_EQ(mock_tpc->GetNumCovered(), 100);
+}
+
+TEST_F(TracePCTest, PathHash) {
+  mock_tpc->TraceOn();
+  mock_tpc->AppendPathLog(0x01);
+  mock_tpc->AppendPathLog(0x02);
+  EXPECT_EQ(mock_tpc->GetPathHash(), mock_tpc->PathHash(ExecPath{0x01, 0x02}));
+  EXPECT_NE(mock_tpc->GetPathHash(), mock_tpc->PathHash(ExecPath{0x02, 0x01}));
+
+  mock_tpc->ClearPathLog();
+  EXPECT_EQ(mock_tpc->GetPathHash(), mock_tpc->PathHash({}));
+}
+
+TEST_F(TracePCTest, LoopCompression) {
+  mock_tpc->SetLoopCompression(2, {1, 2, 3, 4, 8});
+  mock_tpc->TraceOn();
+
+  auto run_loop = [this](size_t iter) {
+    mock_tpc->ClearPathLog();
+    mock_tpc->AppendPathLog(0x01);
+    for (size_t i = 0; i < iter; i++) {
+      mock_tpc->AppendPathLog(0x02);
+      mock_tpc->AppendPathLog(0x03);
+    }
+    mock_tpc->AppendPathLog(0x02);
+    mock_tpc->AppendPathLog(0x04);
+    return mock_tpc->GetPathLog();
+  };
+
+  EXPECT_EQ(run_loop(3), ExecPath({0x01, 0x02, 0x03, 0x02, 0x03, 0x02, 0x03,
+                                   0x02, 0x04}));
+  EXPECT_EQ(run_loop(5), run_loop(7));
+  EXPECT_NE(run_loop(7), run_loop(8));
+
+  ExecPath epath = run_loop(10);
+  EXPECT_EQ(epath.size(), 1 + 2 * 5 + 2);
+  EXPECT_EQ(mock_tpc->GetPathHash(), mock_tpc->PathHash(epath));
+}
+
 TEST_F(TracePCTest, Prune1) {
   ExecPath left = {0x01, 0x02};
   ExecPath right = {0x01, 0x03};
@@ -64,6 +135,144 @@ TEST_F(TracePCTest, Prune2) {
   EXPECT_EQ(epath, ExecPath({0x01, 0x04}));
 }
 
+TEST_F(TracePCTest, CheckDiffChunked) {
+  // Longer than a chunk, which is 100 for the mock.
+  ExecPath left, right;
+  for (PCID i = 0; i < 300; i++) {
+    if (i == 10 || i == 150 || i == 250) left.push_back(0x3C);
+    if (i == 120) right.push_back(0x3D);
+    left.push_back(i % 50 + 1);
+    right.push_back(i % 50 + 1);
+  }
+
+  for (bool patience : {false, true}) {
+    MockTracePC tpc;
+    tpc->SetPatienceDiff(patience);
+    tpc->CheckDiff(left, right);
+    EXPECT_EQ(tpc->GetNumND(), 2);
+    EXPECT_EQ(tpc->Prune(left), tpc->Prune(right));
+  }
+}
+
+TEST_F(TracePCTest, CheckDiffRecountsPrefix) {
+  // 0x3C becomes nondeterministic after ten of its hits are matched in the
+  // common prefix, which is then too short to stop at, once pruned.
+  ExecPath left, right;
+  for (PCID i = 1; i <= 26; i++) {
+    left.push_back(i);
+    right.push_back(i);
+    if (i % 2 == 0 && i <= 20) {
+      left.push_back(0x3C);
+      right.push_back(0x3C);
+    }
+  }
+  left.push_back(0x3C);
+  for (PCID i = 0x3D; i < 0x47; i++) {
+    left.push_back(i);
+    right.push_back(i);
+  }
+  left.push_back(0x50);
+  right.push_back(0x51);
+
+  MockTracePC tpc(100, 40);
+  tpc->CheckDiff(left, right);
+  EXPECT_EQ(tpc->GetNumND(), 3);
+  EXPECT_EQ(tpc->Prune(left), tpc->Prune(right));
+}
+
+TEST_F(TracePCTest, Vote) {
+  mock_tpc->Vote(ExecPath({0x01, 0x02, 0x03, 0x02}));
+  mock_tpc->Vote(ExecPath({0x01, 0x03, 0x02}));
+  mock_tpc->Vote(ExecPath({0x01, 0x04, 0x02, 0x03}));
+  EXPECT_EQ(mock_tpc->AddNDByVotes(), 1);
+  EXPECT_EQ(mock_tpc->Prune(ExecPath({0x01, 0x04})), ExecPath({0x01}));
+
+  mock_tpc->Vote(ExecPath({0x01}));
+  EXPECT_EQ(mock_tpc->AddNDByVotes(), 0);
+}
+
+TEST_F(TracePCTest, ThreadPolicy) {
+  auto run = [this](THREAD_POLICY policy) {
+    mock_tpc->SetThreadPolicy(policy);
+    mock_tpc->TraceOn();
+    mock_tpc->ClearPathLog();
+    mock_tpc->AppendPathLog(0x01);
+    std::thread worker1([this]() {
+      mock_tpc->AppendPathLog(0x03);
+      mock_tpc->AppendPathLog(0x02);
+    });
+    worker1.join();
+    std::thread worker2([this]() { mock_tpc->AppendPathLog(0x02); });
+    worker2.join();
+    mock_tpc->AppendPathLog(0x04);
+    mock_tpc->TraceOff();
+    return mock_tpc->GetPathLog();
+  };
+
+  EXPECT_EQ(run(THREAD_SHARED), ExecPath({0x01, 0x03, 0x02, 0x02, 0x04}));
+  EXPECT_EQ(run(THREAD_MAIN), ExecPath({0x01, 0x04}));
+  EXPECT_EQ(run(THREAD_CONCAT), ExecPath({0x01, 0x04, 0x03, 0x02, 0x02}));
+  EXPECT_EQ(run(THREAD_MERGE), ExecPath({0x01, 0x04, 0x02, 0x03}));
+  EXPECT_EQ(mock_tpc->GetPathHash(),
+            mock_tpc->PathHash(ExecPath{0x01, 0x04, 0x02, 0x03}));
+}
+
+TEST_F(TracePCTest, ThreadLogGrows) {
+  mock_tpc->SetThreadPolicy(THREAD_CONCAT);
+  ExecPath thread_log;
+  for (size_t i = 0; i < 1900; i++) thread_log.push_back(1 + i % 100);
+  // Chunks are reused by the next epoch, which is shorter.
+  for (size_t len : {1900, 1100}) {
+    mock_tpc->TraceOn();
+    mock_tpc->ClearPathLog();
+    std::thread worker([&]() {
+      for (size_t i = 0; i < len; i++) mock_tpc->AppendPathLog(thread_log[i]);
+    });
+    worker.join();
+    mock_tpc->TraceOff();
+    EXPECT_EQ(mock_tpc->GetPathLog(), subvec(thread_log, 0, len));
+  }
+}
+
+TEST_F(TracePCTest, DisableGuard) {
+  mock_tpc->CheckDiff(ExecPath({0x01, 0x02}), ExecPath({0x01, 0x03}));
+  EXPECT_EQ(mock_tpc.get_guard()[0], 0x01);
+  EXPECT_EQ(mock_tpc.get_guard()[1], 0);
+  EXPECT_EQ(mock_tpc.get_guard()[2], 0);
+
+  // Every PC is in this test binary.
+  std::vector<uintptr_t> pcs(200, (uintptr_t)&TPC);
+  mock_tpc->HandlePCsInit(pcs.data(), pcs.data() + pcs.size());
+  EXPECT_EQ(mock_tpc->FilterPCs({"no_such_function"}, {}), 98);
+  EXPECT_EQ(mock_tpc.get_guard()[0], 0);
+}
+
+TEST_F(TracePCTest, PCsOfLastModule) {
+  // A PC table belongs to the module registered right before it, even if an
+  // earlier one has as many guards.
+  std::vector<uint32_t> guard(100, 0);
+  mock_tpc->HandleInit(guard.data(), guard.data() + guard.size());
+  std::vector<uintptr_t> pcs(200, (uintptr_t)&TPC);
+  mock_tpc->HandlePCsInit(pcs.data(), pcs.data() + pcs.size());
+  EXPECT_EQ(mock_tpc->FilterPCs({"no_such_function"}, {}), 100);
+  EXPECT_EQ(mock_tpc.get_guard()[0], 0x01);
+  EXPECT_EQ(guard[0], 0);
+}
+
+TEST_F(TracePCTest, CmpLiterals) {
+  mock_tpc->CollectCmpLiterals(true);
+  mock_tpc->TraceOn();
+  mock_tpc->HandleConstCmp(32, 8);
+  mock_tpc->HandleConstCmp(6, 4);
+  mock_tpc->HandleConstCmp(32, 4);
+  mock_tpc->HandleConstCmp(0xFFFFFFFF, 4);
+  mock_tpc->HandleConstCmp(4096, 8);
+  EXPECT_EQ(mock_tpc->GetCmpLiterals(), std::vector<int>({32, 6}));
+
+  mock_tpc->ClearPathLog();
+  EXPECT_EQ(mock_tpc->GetCmpLiterals(), std::vector<int>());
+}
+
 class ExecPathTest : public testing::Test {
  protected:
   ExecPathTest() {}